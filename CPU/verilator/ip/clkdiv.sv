@@ -0,0 +1,26 @@
+// Simulation model of the clocking wizard IP: the clock is passed
+// through, locked rises a few cycles after the reset is released.
+module clkdiv(
+    input  logic clk_in,
+    input  logic resetn,
+    output logic clk_out,
+    output logic locked
+    );
+
+    logic [3:0] lock_cnt;
+
+    assign clk_out = clk_in;
+
+    always_ff @(posedge clk_in or negedge resetn) begin
+        if(~resetn) begin
+            lock_cnt <= 4'd0;
+            locked   <= 1'b0;
+        end
+        else if(lock_cnt != 4'hf) begin
+            lock_cnt <= lock_cnt + 4'd1;
+        end
+        else begin
+            locked   <= 1'b1;
+        end
+    end
+endmodule
@@ -0,0 +1,24 @@
+// Simulation model of the data_ram distributed RAM IP (16K words,
+// asynchronous read, synchronous write). tb.cpp passes the initial
+// content as +data_ram=<hex file>.
+module data_ram(
+    input  logic [13:0] a,
+    input  logic [31:0] d,
+    input  logic        clk,
+    input  logic        we,
+    output logic [31:0] spo
+    );
+
+    logic [31:0] mem[0:16383];
+    string file;
+
+    initial begin
+        if($value$plusargs("data_ram=%s", file)) $readmemh(file, mem);
+    end
+
+    always_ff @(posedge clk) begin
+        if(we) mem[a] <= d;
+    end
+
+    assign spo = mem[a];
+endmodule
@@ -0,0 +1,16 @@
+// Simulation model of the inst_rom distributed ROM IP (16K words,
+// asynchronous read). tb.cpp passes the image as +inst_rom=<hex file>.
+module inst_rom(
+    input  logic [13:0] a,
+    output logic [31:0] spo
+    );
+
+    logic [31:0] mem[0:16383];
+    string file;
+
+    initial begin
+        if($value$plusargs("inst_rom=%s", file)) $readmemh(file, mem);
+    end
+
+    assign spo = mem[a];
+endmodule
@@ -0,0 +1,25 @@
+// Verilator top of the lockstep testbench (tb.cpp): the SoC of the CPU
+// project, with its debug writeback signals brought out to ports as
+// tb_MiniMIPS32_Lite_FullSyS.sv does with hierarchical references.
+module sim_top(
+    input  logic        sys_clk,
+    input  logic        sys_rst_n,
+
+    output logic        cpu_clk,
+    output logic [31:0] debug_wb_pc,
+    output logic        debug_wb_rf_wen,
+    output logic [ 4:0] debug_wb_rf_wnum,
+    output logic [31:0] debug_wb_rf_wdata
+    );
+
+    MiniMIPS32_Lite_FullSyS SoC(
+        .sys_clk(sys_clk),
+        .sys_rst_n(sys_rst_n)
+    );
+
+    assign cpu_clk           = SoC.cpu_clk;
+    assign debug_wb_pc       = SoC.debug_wb_pc;
+    assign debug_wb_rf_wen   = SoC.debug_wb_rf_wen;
+    assign debug_wb_rf_wnum  = SoC.debug_wb_rf_wnum;
+    assign debug_wb_rf_wdata = SoC.debug_wb_rf_wdata;
+endmodule
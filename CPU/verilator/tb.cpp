@@ -0,0 +1,211 @@
+// Verilator testbench of MiniMIPS32_Lite_FullSyS. TEMU runs in the same
+// process (libtemu) and every writeback of the RTL is checked against
+// the next register write of TEMU as it happens, so no golden trace is
+// written or diffed. The run stops at the first divergence, when TEMU
+// hits a trap, or after --max-cycles.
+//
+//   tb [--max-cycles N] [--quiet] <inst.coe|inst.bin> [data.coe|data.bin]
+//   tb [--max-cycles N] [--quiet] <program.elf>
+//
+// Exit code: 0 when all writebacks matched up to the trap, 1 on a
+// mismatch, 2 on timeout, 3 on a usage or load error.
+
+#include "Vsim_top.h"
+#include "verilated.h"
+#include "libtemu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <elf.h>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define INST_BASE 0x80000000u
+#define DATA_BASE 0x80010000u
+#define MEM_WORDS 16384
+
+struct Writeback {
+    uint32_t pc, wnum, wdata;
+};
+
+static std::deque<Writeback> ref_wb;
+
+static int on_trace(void *user, uint32_t pc, uint32_t reg, uint32_t value) {
+    // the RTL does not report writes to $0
+    if(reg == 0) return 0;
+    ref_wb.push_back({pc, reg, value});
+    return 1;
+}
+
+static bool ends_with(const std::string &s, const char *suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool read_file(const std::string &path, std::vector<uint8_t> &buf) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return false;
+    buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// The COE files of mips_sc/convert.c list the bytes of each word in
+// memory order, which is also the order the ROM/RAM models expect.
+static bool read_coe(const std::string &path, std::vector<uint8_t> &buf) {
+    std::ifstream in(path);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t pos = text.find("memory_initialization_vector");
+    if(!in.is_open() || pos == std::string::npos || (pos = text.find('=', pos)) == std::string::npos) return false;
+
+    std::string tok;
+    std::istringstream ss(text.substr(pos + 1));
+    buf.clear();
+    while(ss >> tok) {
+        while(!tok.empty() && (tok.back() == ',' || tok.back() == ';')) tok.pop_back();
+        for(size_t i = 0; i + 1 < tok.size(); i += 2) {
+            buf.push_back(strtoul(tok.substr(i, 2).c_str(), NULL, 16));
+        }
+    }
+    return true;
+}
+
+static bool read_image(const std::string &path, std::vector<uint8_t> &buf) {
+    return ends_with(path, ".coe") ? read_coe(path, buf) : read_file(path, buf);
+}
+
+// Split the loadable segments of an ELF file linked by mips_sc into the
+// contents of inst_rom and data_ram.
+static bool read_elf(const std::string &path, std::vector<uint8_t> &inst, std::vector<uint8_t> &data) {
+    std::vector<uint8_t> file;
+    if(!read_file(path, file) || file.size() < sizeof(Elf32_Ehdr)) return false;
+
+    const Elf32_Ehdr *eh = (const Elf32_Ehdr *)file.data();
+    if(memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+            eh->e_machine != EM_MIPS) return false;
+
+    for(int i = 0; i < eh->e_phnum; i ++) {
+        size_t off = eh->e_phoff + i * eh->e_phentsize;
+        if(off + sizeof(Elf32_Phdr) > file.size()) return false;
+        const Elf32_Phdr *ph = (const Elf32_Phdr *)(file.data() + off);
+        if(ph->p_type != PT_LOAD || ph->p_filesz == 0) continue;
+        if(ph->p_offset + ph->p_filesz > file.size()) return false;
+
+        bool is_data = ph->p_vaddr >= DATA_BASE;
+        std::vector<uint8_t> &dst = is_data ? data : inst;
+        uint32_t base = ph->p_vaddr - (is_data ? DATA_BASE : INST_BASE);
+        if(dst.size() < base + ph->p_filesz) dst.resize(base + ph->p_filesz);
+        memcpy(dst.data() + base, file.data() + ph->p_offset, ph->p_filesz);
+    }
+    return !inst.empty();
+}
+
+static bool write_hex(const char *path, const std::vector<uint8_t> &buf) {
+    FILE *fp = fopen(path, "w");
+    if(fp == NULL) return false;
+    for(size_t i = 0; i < buf.size() && i < MEM_WORDS * 4; i += 4) {
+        uint8_t w[4] = {0, 0, 0, 0};
+        memcpy(w, buf.data() + i, std::min<size_t>(4, buf.size() - i));
+        fprintf(fp, "%02x%02x%02x%02x\n", w[0], w[1], w[2], w[3]);
+    }
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint64_t max_cycles = 100000000;
+    bool quiet = false;
+    std::vector<std::string> images;
+
+    for(int i = 1; i < argc; i ++) {
+        if(strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc) max_cycles = strtoull(argv[++ i], NULL, 0);
+        else if(strcmp(argv[i], "--quiet") == 0) quiet = true;
+        else if(argv[i][0] != '+') images.push_back(argv[i]);
+    }
+    if(images.empty() || images.size() > 2) {
+        fprintf(stderr, "Usage: %s [--max-cycles N] [--quiet] <inst.coe|inst.bin|prog.elf> [data.coe|data.bin]\n", argv[0]);
+        return 3;
+    }
+
+    std::vector<uint8_t> inst, data;
+    bool ok = images.size() == 1 && !ends_with(images[0], ".coe") && !ends_with(images[0], ".bin")
+        ? read_elf(images[0], inst, data)
+        : read_image(images[0], inst) && (images.size() == 1 || read_image(images[1], data));
+    if(!ok || !write_hex("tb_inst_rom.hex", inst) || !write_hex("tb_data_ram.hex", data)) {
+        fprintf(stderr, "tb: cannot load %s\n", images[0].c_str());
+        return 3;
+    }
+
+    // the reference
+    temu_t *temu = temu_create();
+    temu_write_mem(temu, INST_BASE, inst.data(), inst.size());
+    temu_write_mem(temu, DATA_BASE, data.data(), data.size());
+    temu_on_trace(temu, on_trace, NULL);
+
+    // the DUT
+    const std::unique_ptr<VerilatedContext> ctx{new VerilatedContext};
+    const char *plusargs[] = { argv[0], "+inst_rom=tb_inst_rom.hex", "+data_ram=tb_data_ram.hex" };
+    ctx->commandArgs(3, plusargs);
+    const std::unique_ptr<Vsim_top> top{new Vsim_top{ctx.get()}};
+
+    uint64_t cycles = 0, checked = 0;
+    int ret = 2;
+    auto start = std::chrono::steady_clock::now();
+
+    top->sys_rst_n = 0;
+    top->sys_clk = 0;
+    top->eval();
+    for(; cycles < max_cycles && ret == 2; cycles ++) {
+        if(cycles == 4) top->sys_rst_n = 1;
+
+        // sample the writeback of this cycle before the rising edge, like
+        // @(posedge cpu_clk) in tb_MiniMIPS32_Lite_FullSyS.sv
+        if(top->debug_wb_rf_wen && top->debug_wb_rf_wnum != 0) {
+            uint32_t pc = top->debug_wb_pc, wnum = top->debug_wb_rf_wnum, wdata = top->debug_wb_rf_wdata;
+            while(ref_wb.empty() && temu_exit_code(temu) < 0) temu_run(temu, UINT64_MAX, NULL);
+            if(ref_wb.empty()) {
+                fprintf(stderr, "tb: TEMU ended, but the RTL writes $%u = 0x%08x at pc = 0x%08x\n", wnum, wdata, pc);
+                ret = 1;
+                break;
+            }
+            Writeback ref = ref_wb.front();
+            ref_wb.pop_front();
+            if((pc & 0x1fffffff) != ref.pc || wnum != ref.wnum || wdata != ref.wdata) {
+                fprintf(stderr, "tb: mismatch at cycle %llu after %llu writebacks\n",
+                        (unsigned long long)cycles, (unsigned long long)checked);
+                fprintf(stderr, "  reference: PC = 0x%08x, wb_rf_wnum = 0x%02x, wb_rf_wdata = 0x%08x\n", ref.pc, ref.wnum, ref.wdata);
+                fprintf(stderr, "  rtl:       PC = 0x%08x, wb_rf_wnum = 0x%02x, wb_rf_wdata = 0x%08x\n", pc & 0x1fffffff, wnum, wdata);
+                ret = 1;
+                break;
+            }
+            checked ++;
+            if(!quiet) printf("PC = 0x%08x, wb_rf_wnum = 0x%02x, wb_rf_wdata = 0x%08x\n", pc, wnum, wdata);
+
+            // passed once TEMU has no writeback left before its trap
+            while(ref_wb.empty() && temu_exit_code(temu) < 0) temu_run(temu, UINT64_MAX, NULL);
+            if(ref_wb.empty()) ret = temu_exit_code(temu) == 0 ? 0 : 1;
+        }
+
+        top->sys_clk = 1;
+        top->eval();
+        top->sys_clk = 0;
+        top->eval();
+        ctx->timeInc(10);
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    top->final();
+
+    if(ret == 2) fprintf(stderr, "tb: timeout after %llu cycles\n", (unsigned long long)cycles);
+    printf("tb: %s, %llu writebacks checked, %llu cycles in %.3f s, %.0f cycles/s, %llu TEMU instructions\n",
+            ret == 0 ? "PASS" : "FAIL", (unsigned long long)checked, (unsigned long long)cycles, secs,
+            secs > 0 ? cycles / secs : 0.0, (unsigned long long)temu_instr_count(temu));
+    temu_destroy(temu);
+    return ret;
+}
@@ -0,0 +1,24 @@
+#include "semihost.h"
+
+/* C程序示例：crt0.S设置栈并清零.bss，c.ld把.rodata放进inst.bin、
+ * .data放进data.bin。main()返回0为good trap。
+ */
+
+int primes[8] = { 2, 3, 5, 7, 11, 13, 17, 19 };
+int squares[8];
+const char hello[] = "hello, world\n";
+
+int main() {
+	int i, sum = 0;
+
+	for(i = 0; i < 8; i ++) {
+		squares[i] = primes[i] * primes[i];
+	}
+	for(i = 0; i < 8; i ++) {
+		sum += squares[i];
+	}
+	sh_write(1, hello, sizeof(hello) - 1);
+
+	/* 4 + 9 + 25 + 49 + 121 + 169 + 289 + 361 */
+	return sum == 1027 ? 0 : 1;
+}
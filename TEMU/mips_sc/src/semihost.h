@@ -0,0 +1,34 @@
+#ifndef __SEMIHOST_H__
+#define __SEMIHOST_H__
+
+/* Host file I/O for C programs run on TEMU, see
+ * temu/include/device/semihost.h for the calling convention.
+ * A negative return value is -errno of the host.
+ */
+
+enum { SH_OPEN = 1, SH_READ, SH_WRITE, SH_CLOSE, SH_EXIT, SH_CLOCK };
+
+#define SH_O_RDONLY 0x0
+#define SH_O_WRONLY 0x1
+#define SH_O_RDWR 0x2
+#define SH_O_CREAT 0x100
+#define SH_O_TRUNC 0x200
+#define SH_O_APPEND 0x400
+
+static inline int semihost(int op, int a0, int a1, int a2) {
+	register int v0 asm("$2") = op;
+	register int r4 asm("$4") = a0;
+	register int r5 asm("$5") = a1;
+	register int r6 asm("$6") = a2;
+	asm volatile(".word 0x4a800000" : "+r"(v0) : "r"(r4), "r"(r5), "r"(r6) : "memory");
+	return v0;
+}
+
+static inline int sh_open(const char *path, int flags) { return semihost(SH_OPEN, (int)path, flags, 0); }
+static inline int sh_read(int fd, void *buf, unsigned len) { return semihost(SH_READ, fd, (int)buf, len); }
+static inline int sh_write(int fd, const void *buf, unsigned len) { return semihost(SH_WRITE, fd, (int)buf, len); }
+static inline int sh_close(int fd) { return semihost(SH_CLOSE, fd, 0, 0); }
+static inline void sh_exit(int code) { semihost(SH_EXIT, code, 0, 0); for(;;); }
+static inline unsigned sh_clock() { return semihost(SH_CLOCK, 0, 0, 0); }
+
+#endif
@@ -4,3 +4,7 @@
 #define HIT_BAD_TRAP \
 	.word 0x4b000000
 
+
+/* semihosting call, operation in $v0, see temu/include/device/semihost.h */
+#define SEMIHOST \
+	.word 0x4a800000
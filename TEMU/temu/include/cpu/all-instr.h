@@ -1,3 +0,0 @@
-#include "r-type.h"
-#include "i-type.h"
-#include "special.h"
@@ -0,0 +1,46 @@
+#ifndef __CP0_H__
+#define __CP0_H__
+
+#include "common.h"
+#include <stdio.h>
+
+enum { CP0_BADVADDR = 8, CP0_COUNT = 9, CP0_COMPARE = 11, CP0_STATUS = 12, CP0_CAUSE = 13, CP0_EPC = 14 };
+
+#define STATUS_IE 0x00000001
+#define STATUS_EXL 0x00000002
+#define STATUS_IM_MASK 0x0000ff00
+
+#define CAUSE_IP_MASK 0x0000ff00
+#define CAUSE_IP(line) (0x100 << (line))
+#define CAUSE_EXC_SHIFT 2
+#define CAUSE_EXC_MASK 0x0000007c
+#define CAUSE_TI 0x40000000
+#define CAUSE_BD 0x80000000
+
+/* the Count/Compare timer raises hardware interrupt 5, i.e. IP7 */
+#define TIMER_IRQ_LINE 7
+
+enum { EXC_INT = 0, EXC_ADEL = 4, EXC_ADES = 5, EXC_SYS = 8, EXC_BP = 9, EXC_OV = 12, EXC_TR = 13 };
+
+/* general exception vector with Status.BEV = 0 */
+#define EXC_VECTOR 0x80000180
+
+void init_cp0();
+uint32_t cp0_read(int reg);
+void cp0_write(int reg, uint32_t val);
+
+/* Drive interrupt line `line' (2-7) of a device. */
+void cp0_set_irq(int line, bool level);
+
+/* Enter the exception handler, `epc' is where the guest resumes after eret,
+ * or the instruction in a delay slot, then the guest resumes at the branch.
+ * Return the address of the handler.
+ */
+uint32_t raise_exception(int exccode, uint32_t epc);
+
+/* Leave the exception handler, return the address to resume at. */
+uint32_t cp0_eret();
+
+void cp0_report(FILE *fp);
+
+#endif
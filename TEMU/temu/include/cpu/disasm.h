@@ -0,0 +1,11 @@
+#ifndef __DISASM_H__
+#define __DISASM_H__
+
+#include "common.h"
+
+/* Disassemble `instr' at `pc' into `buf' without executing it, in the
+ * syntax of the log.
+ */
+void disasm(uint32_t pc, uint32_t instr, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __FUSION_H__
+#define __FUSION_H__
+
+#include "common.h"
+
+/* Superinstructions: common pairs of instructions run as one operation,
+ * with a single dispatch and no fetch or decode for either of them. The
+ * interpreter learns a pair when it executes the two instructions one
+ * after the other, and keeps the pair in a cache indexed by the physical
+ * pc of the first one. Both register writes are recorded in order, the
+ * golden trace is the same with or without fusion.
+ *
+ * The first instruction of a pair never branches or raises an
+ * exception. A pair is only run when nothing looks at the instructions
+ * one by one (see cpu_exec()), i.e. without watchpoints and observers
+ * other than of the register writes, and when no event is due after the
+ * first instruction.
+ */
+
+/* X(first, second) */
+#define FUSION_TABLE(X) \
+	X(lui, ori) \
+	X(lui, addiu) \
+	X(lui, lw) \
+	X(lui, sw) \
+	X(addiu, bne) \
+	X(addiu, beq) \
+	X(slt, bne) \
+	X(slt, beq) \
+	X(sltu, bne) \
+	X(sltu, beq) \
+	X(slti, bne) \
+	X(slti, beq) \
+	X(sltiu, bne) \
+	X(sltiu, beq)
+
+/* on by default, --no-fusion turns it off */
+extern bool fusion_enabled;
+
+/* the physical address space of the pc, 4KB pages */
+#define FUSION_NR_PAGES (0x20000000 >> 12)
+
+/* pages that hold cached pairs */
+extern uint8_t fusion_pages[FUSION_NR_PAGES];
+
+/* Register the fusion.* metrics, once. */
+void init_fusion();
+
+/* Drop all pairs, after hw_mem was rewritten. */
+void fusion_flush();
+
+/* Drop the pairs that read the page of `paddr'. */
+void fusion_drop_page(uint32_t paddr);
+
+/* Run the pair at `pc', the physical address of the first instruction,
+ * when it is cached, and return the number of instructions executed.
+ * With 2 the first instruction is retired, cpu.pc and `instr' are those
+ * of the second one and `first' is the first one. With 1 the run was
+ * stopped by the first instruction (e.g. by a writeback observer), which
+ * is then left to retire like after exec(). 0 means not cached.
+ */
+int exec_fused(uint32_t pc, uint32_t *first);
+
+/* hw_mem was written at [paddr, paddr + len) */
+static inline void fusion_invalidate(uint32_t paddr, size_t len) {
+	uint32_t page;
+	if(len == 0) { return; }
+	for(page = paddr >> 12; page <= (paddr + len - 1) >> 12 && page < FUSION_NR_PAGES; page ++) {
+		if(fusion_pages[page]) { fusion_drop_page(page << 12); }
+	}
+}
+
+#endif
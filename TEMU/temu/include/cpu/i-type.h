@@ -1,17 +0,0 @@
-#ifndef __ITYPE_H__
-#define __ITYPE_H__
-
-make_helper(lui);
-make_helper(ori);
-make_helper(andi);
-make_helper(addiu);
-make_helper(beq);
-make_helper(bne);
-make_helper(blez);
-make_helper(lw);
-make_helper(lb);
-make_helper(sw);
-make_helper(sb);
-
-#endif
-
@@ -0,0 +1,223 @@
+#ifndef __ISA_H__
+#define __ISA_H__
+
+#include "common.h"
+
+/* The instruction set of TEMU, in one place. Every instruction is an
+ * entry X(id, mnemonic, index, format) of the table of its encoding
+ * class, where `index' is the value of the field that selects it in the
+ * class. The tables generate the decoder below, the interpreter switch
+ * in exec.c, whose semantics are the EXEC(id) bodies, and the
+ * disassembler in disasm.c. An instruction without a body does not
+ * compile, one without an entry is never decoded.
+ */
+
+/* operand syntax, for the disassembler */
+enum {
+	F_NONE,			/* syscall */
+	F_RD_RS_RT,		/* addu rd, rs, rt */
+	F_RD_RT_SA,		/* sll rd, rt, sa */
+	F_RD_RT_RS,		/* sllv rd, rt, rs */
+	F_RS,			/* jr rs */
+	F_RD,			/* mfhi rd */
+	F_RS_RT,		/* mult rs, rt */
+	F_RD_RS,		/* jalr rd, rs */
+	F_RT_RS_IMM,		/* addiu rt, rs, imm */
+	F_RT_IMM,		/* lui rt, imm */
+	F_RT_MEM,		/* lw rt, offset(base) */
+	F_RS_RT_BRANCH,		/* beq rs, rt, target */
+	F_RS_BRANCH,		/* blez rs, target */
+	F_RS_SIMM,		/* teqi rs, imm */
+	F_JUMP,			/* j target */
+	F_CACHE,		/* cache op, offset(base) */
+	F_RT_CP0		/* mfc0 rt, $rd */
+};
+
+/* indexed by the opcode */
+#define ISA_OPCODE(X) \
+	X(j,       "j",       0x02, F_JUMP) \
+	X(jal,     "jal",     0x03, F_JUMP) \
+	X(beq,     "beq",     0x04, F_RS_RT_BRANCH) \
+	X(bne,     "bne",     0x05, F_RS_RT_BRANCH) \
+	X(blez,    "blez",    0x06, F_RS_BRANCH) \
+	X(bgtz,    "bgtz",    0x07, F_RS_BRANCH) \
+	X(addi,    "addi",    0x08, F_RT_RS_IMM) \
+	X(addiu,   "addiu",   0x09, F_RT_RS_IMM) \
+	X(slti,    "slti",    0x0a, F_RT_RS_IMM) \
+	X(sltiu,   "sltiu",   0x0b, F_RT_RS_IMM) \
+	X(andi,    "andi",    0x0c, F_RT_RS_IMM) \
+	X(ori,     "ori",     0x0d, F_RT_RS_IMM) \
+	X(xori,    "xori",    0x0e, F_RT_RS_IMM) \
+	X(lui,     "lui",     0x0f, F_RT_IMM) \
+	X(beql,    "beql",    0x14, F_RS_RT_BRANCH) \
+	X(bnel,    "bnel",    0x15, F_RS_RT_BRANCH) \
+	X(blezl,   "blezl",   0x16, F_RS_BRANCH) \
+	X(bgtzl,   "bgtzl",   0x17, F_RS_BRANCH) \
+	X(lb,      "lb",      0x20, F_RT_MEM) \
+	X(lh,      "lh",      0x21, F_RT_MEM) \
+	X(lwl,     "lwl",     0x22, F_RT_MEM) \
+	X(lw,      "lw",      0x23, F_RT_MEM) \
+	X(lbu,     "lbu",     0x24, F_RT_MEM) \
+	X(lhu,     "lhu",     0x25, F_RT_MEM) \
+	X(lwr,     "lwr",     0x26, F_RT_MEM) \
+	X(sb,      "sb",      0x28, F_RT_MEM) \
+	X(sh,      "sh",      0x29, F_RT_MEM) \
+	X(swl,     "swl",     0x2a, F_RT_MEM) \
+	X(sw,      "sw",      0x2b, F_RT_MEM) \
+	X(swr,     "swr",     0x2e, F_RT_MEM) \
+	X(cache,   "cache",   0x2f, F_CACHE) \
+	X(ll,      "ll",      0x30, F_RT_MEM) \
+	X(pref,    "pref",    0x33, F_CACHE) \
+	X(sc,      "sc",      0x38, F_RT_MEM)
+
+/* opcode 0x00, indexed by the function field */
+#define ISA_SPECIAL(X) \
+	X(sll,     "sll",     0x00, F_RD_RT_SA) \
+	X(srl,     "srl",     0x02, F_RD_RT_SA) \
+	X(sra,     "sra",     0x03, F_RD_RT_SA) \
+	X(sllv,    "sllv",    0x04, F_RD_RT_RS) \
+	X(srlv,    "srlv",    0x06, F_RD_RT_RS) \
+	X(srav,    "srav",    0x07, F_RD_RT_RS) \
+	X(jr,      "jr",      0x08, F_RS) \
+	X(jalr,    "jalr",    0x09, F_RD_RS) \
+	X(movz,    "movz",    0x0a, F_RD_RS_RT) \
+	X(movn,    "movn",    0x0b, F_RD_RS_RT) \
+	X(syscall, "syscall", 0x0c, F_NONE) \
+	X(break,   "break",   0x0d, F_NONE) \
+	X(sync,    "sync",    0x0f, F_NONE) \
+	X(mfhi,    "mfhi",    0x10, F_RD) \
+	X(mthi,    "mthi",    0x11, F_RS) \
+	X(mflo,    "mflo",    0x12, F_RD) \
+	X(mtlo,    "mtlo",    0x13, F_RS) \
+	X(mult,    "mult",    0x18, F_RS_RT) \
+	X(multu,   "multu",   0x19, F_RS_RT) \
+	X(div,     "div",     0x1a, F_RS_RT) \
+	X(divu,    "divu",    0x1b, F_RS_RT) \
+	X(add,     "add",     0x20, F_RD_RS_RT) \
+	X(addu,    "addu",    0x21, F_RD_RS_RT) \
+	X(sub,     "sub",     0x22, F_RD_RS_RT) \
+	X(subu,    "subu",    0x23, F_RD_RS_RT) \
+	X(and,     "and",     0x24, F_RD_RS_RT) \
+	X(or,      "or",      0x25, F_RD_RS_RT) \
+	X(xor,     "xor",     0x26, F_RD_RS_RT) \
+	X(nor,     "nor",     0x27, F_RD_RS_RT) \
+	X(slt,     "slt",     0x2a, F_RD_RS_RT) \
+	X(sltu,    "sltu",    0x2b, F_RD_RS_RT) \
+	X(tge,     "tge",     0x30, F_RS_RT) \
+	X(tgeu,    "tgeu",    0x31, F_RS_RT) \
+	X(tlt,     "tlt",     0x32, F_RS_RT) \
+	X(tltu,    "tltu",    0x33, F_RS_RT) \
+	X(teq,     "teq",     0x34, F_RS_RT) \
+	X(tne,     "tne",     0x36, F_RS_RT)
+
+/* opcode 0x01, indexed by the rt field */
+#define ISA_REGIMM(X) \
+	X(bltz,    "bltz",    0x00, F_RS_BRANCH) \
+	X(bgez,    "bgez",    0x01, F_RS_BRANCH) \
+	X(bltzl,   "bltzl",   0x02, F_RS_BRANCH) \
+	X(bgezl,   "bgezl",   0x03, F_RS_BRANCH) \
+	X(tgei,    "tgei",    0x08, F_RS_SIMM) \
+	X(tgeiu,   "tgeiu",   0x09, F_RS_SIMM) \
+	X(tlti,    "tlti",    0x0a, F_RS_SIMM) \
+	X(tltiu,   "tltiu",   0x0b, F_RS_SIMM) \
+	X(teqi,    "teqi",    0x0c, F_RS_SIMM) \
+	X(tnei,    "tnei",    0x0e, F_RS_SIMM) \
+	X(bltzal,  "bltzal",  0x10, F_RS_BRANCH) \
+	X(bgezal,  "bgezal",  0x11, F_RS_BRANCH) \
+	X(bltzall, "bltzall", 0x12, F_RS_BRANCH) \
+	X(bgezall, "bgezall", 0x13, F_RS_BRANCH)
+
+/* opcode 0x1c, indexed by the function field */
+#define ISA_SPECIAL2(X) \
+	X(madd,    "madd",    0x00, F_RS_RT) \
+	X(maddu,   "maddu",   0x01, F_RS_RT) \
+	X(mul,     "mul",     0x02, F_RD_RS_RT) \
+	X(msub,    "msub",    0x04, F_RS_RT) \
+	X(msubu,   "msubu",   0x05, F_RS_RT) \
+	X(clz,     "clz",     0x20, F_RD_RS) \
+	X(clo,     "clo",     0x21, F_RD_RS)
+
+/* opcode 0x10, indexed by the rs field */
+#define ISA_COP0(X) \
+	X(mfc0,    "mfc0",    0x00, F_RT_CP0) \
+	X(mtc0,    "mtc0",    0x04, F_RT_CP0)
+
+/* opcode 0x10 with rs = 0x10 (CO), indexed by the function field */
+#define ISA_COP0_CO(X) \
+	X(eret,    "eret",    0x18, F_NONE)
+
+/* opcode 0x12, indexed by the rs field: the traps of TEMU, the
+ * semihosting call is SEMIHOST_RS (see device/semihost.h)
+ */
+#define ISA_TRAP(X) \
+	X(good_trap, "good trap", 0x10, F_NONE) \
+	X(semihost,  "semihost",  0x14, F_NONE) \
+	X(bad_trap,  "bad trap",  0x18, F_NONE)
+
+#define ISA_TABLE(X) ISA_OPCODE(X) ISA_SPECIAL(X) ISA_REGIMM(X) ISA_SPECIAL2(X) \
+	ISA_COP0(X) ISA_COP0_CO(X) ISA_TRAP(X)
+
+#define ISA_ENUM(id, name, index, format) I_##id,
+enum { I_INVALID, ISA_TABLE(ISA_ENUM) NR_ISA_INSTR };
+#undef ISA_ENUM
+
+/* Instruction fields, X(name, shift, width) */
+#define ISA_FIELDS(X) \
+	X(opcode, 26, 6) \
+	X(rs,     21, 5) \
+	X(rt,     16, 5) \
+	X(rd,     11, 5) \
+	X(sa,      6, 5) \
+	X(func,    0, 6) \
+	X(imm,     0, 16) \
+	X(index,   0, 26)
+
+#define ISA_FIELD(name, shift, width) \
+	static inline uint32_t isa_##name(uint32_t instr) { return (instr >> (shift)) & ((1u << (width)) - 1); }
+ISA_FIELDS(ISA_FIELD)
+#undef ISA_FIELD
+
+/* the immediate, sign-extended */
+static inline int32_t isa_simm(uint32_t instr) { return (int16_t)instr; }
+
+/* the target of a branch at `pc' */
+static inline uint32_t isa_branch_target(uint32_t pc, uint32_t instr) {
+	return pc + 4 + (isa_simm(instr) << 2);
+}
+
+/* the target stays in the 256MB region of the delay slot */
+static inline uint32_t isa_jump_target(uint32_t pc, uint32_t instr) {
+	return ((pc + 4) & 0xf0000000) | (isa_index(instr) << 2);
+}
+
+/* Return the I_* id of `instr', I_INVALID if it is not implemented. */
+static inline int isa_decode(uint32_t instr) {
+#define ISA_CASE(id, name, index, format) case index: return I_##id;
+	switch(isa_opcode(instr)) {
+		case 0x00:
+			switch(isa_func(instr)) { ISA_SPECIAL(ISA_CASE) }
+			break;
+		case 0x01:
+			switch(isa_rt(instr)) { ISA_REGIMM(ISA_CASE) }
+			break;
+		case 0x10:
+			if(isa_rs(instr) == 0x10) {
+				switch(isa_func(instr)) { ISA_COP0_CO(ISA_CASE) }
+			}
+			else {
+				switch(isa_rs(instr)) { ISA_COP0(ISA_CASE) }
+			}
+			break;
+		case 0x12:
+			switch(isa_rs(instr)) { ISA_TRAP(ISA_CASE) }
+			break;
+		case 0x1c:
+			switch(isa_func(instr)) { ISA_SPECIAL2(ISA_CASE) }
+			break;
+		ISA_OPCODE(ISA_CASE)
+	}
+	return I_INVALID;
+#undef ISA_CASE
+}
+
+#endif
@@ -1,13 +0,0 @@
-#ifndef __RTYPE_H__
-#define __RTYPE_H__
-
-make_helper(and);
-make_helper(or);
-make_helper(xor);
-make_helper(addu);
-make_helper(sll);
-make_helper(slt);
-make_helper(srlv);
-
-#endif
-
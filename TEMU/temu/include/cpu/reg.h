@@ -23,6 +23,15 @@ typedef struct {
 	uint32_t pc;
 	uint32_t hi, lo;
 
+	/* coprocessor 0, Count is derived from nr_instr, use cp0_read() */
+	uint32_t cp0[32];
+
+	/* The instruction at pc is in the delay slot of a branch, after it
+	 * the execution continues at branch_target (see cpu_exec()).
+	 */
+	bool delay_slot;
+	uint32_t branch_target;
+
 } CPU_state;
 
 extern CPU_state cpu;
@@ -1,7 +0,0 @@
-#ifndef __SPECIAL_H__
-#define __SPECIAL_H__
-
-make_helper(inv);
-make_helper(temu_trap);
-
-#endif
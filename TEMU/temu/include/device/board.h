@@ -0,0 +1,42 @@
+#ifndef __BOARD_H__
+#define __BOARD_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* The board I/O of the SoC (LEDs, x7seg, switches and buttons), at guest
+ * address 0xbfd0f000:
+ *   +0x00 led     r/w  led[31:0]
+ *   +0x04 seg     r/w  seven-segment digits 0-7, 4 bits each, digit 0 in [3:0]
+ *   +0x08 seg_hi  r/w  seven-segment digit 8 in [3:0]
+ *   +0x0c sw_1    r    first group of DIP switches
+ *   +0x10 sw_2    r    second group of DIP switches
+ *   +0x14 btn     r    btn[7:0]
+ * The inputs are set from the monitor.
+ */
+#define BOARD_BASE 0x3fd0f000
+#define BOARD_SIZE 0x18
+
+enum { BOARD_LED, BOARD_SEG, BOARD_SEG_HI, BOARD_SW_1, BOARD_SW_2, BOARD_BTN, NR_BOARD_REG };
+
+/* increased on every change, so that a display only redraws when needed */
+extern uint32_t board_generation;
+
+void init_board();
+
+/* Clear the outputs and the inputs, on a reset of the machine. */
+void board_reset();
+
+uint32_t board_get(int reg);
+int board_find(const char *name);
+bool board_set_input(int reg, uint32_t value);
+
+/* Log every change of the board state with the instruction count.
+ * Without a log, only the final values and the change counts are kept.
+ */
+bool board_log_open(const char *filename);
+void board_log_close();
+
+void board_report(FILE *fp);
+
+#endif
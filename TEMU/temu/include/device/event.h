@@ -0,0 +1,21 @@
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#include "common.h"
+
+/* Events are callbacks due at an instruction count (see nr_instr). They
+ * run between two instructions, after the earlier one has retired.
+ */
+typedef void (*event_handler_t)(void *arg);
+
+/* due time of the earliest event, so that cpu_exec() only pays one
+ * comparison per instruction
+ */
+extern uint64_t next_event;
+
+void event_schedule(uint64_t when, event_handler_t handler, void *arg);
+void event_cancel(event_handler_t handler, void *arg);
+void event_run();
+void event_reset();
+
+#endif
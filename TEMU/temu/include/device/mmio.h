@@ -0,0 +1,35 @@
+#ifndef __MMIO_H__
+#define __MMIO_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* Devices are mapped above the DRAM. An address is the physical address
+ * seen by mem_read()/mem_write(), i.e. the guest address & 0x7fffffff.
+ */
+typedef uint32_t (*mmio_read_t)(void *opaque, uint32_t offset, size_t len);
+typedef void (*mmio_write_t)(void *opaque, uint32_t offset, size_t len, uint32_t data);
+
+typedef struct {
+	const char *name;
+	uint32_t base, size;
+	mmio_read_t read;
+	mmio_write_t write;
+	void (*sync)();		/* called when cpu_exec() returns, may be NULL */
+	void *opaque;		/* passed to read and write */
+} MMIORegion;
+
+/* lowest mapped address, so that DRAM accesses only pay one comparison */
+extern uint32_t mmio_low;
+
+void mmio_register(const char *name, uint32_t base, uint32_t size,
+		mmio_read_t read, mmio_write_t write, void (*sync)(), void *opaque);
+void mmio_unregister(const char *name);
+bool mmio_overlap(uint32_t base, uint32_t size);
+MMIORegion *mmio_find(uint32_t paddr);
+void mmio_sync();
+void mmio_list(FILE *fp);
+
+void init_device();
+
+#endif
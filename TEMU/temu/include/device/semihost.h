@@ -0,0 +1,39 @@
+#ifndef __SEMIHOST_H__
+#define __SEMIHOST_H__
+
+#include "common.h"
+
+/* Semihosting lets the guest use files of the host. The guest executes
+ * the reserved instruction SEMIHOST_INSTR (opcode 0x12 like the good trap)
+ * with the operation in $v0 and the arguments in $a0-$a2. The result is
+ * returned in $v0, a negative value is -errno of the host.
+ *
+ *   SH_OPEN   path, flags       -> fd
+ *   SH_READ   fd, buf, len      -> bytes read
+ *   SH_WRITE  fd, buf, len      -> bytes written
+ *   SH_CLOSE  fd                -> 0
+ *   SH_EXIT   code              stops TEMU, good trap if code is 0
+ *   SH_CLOCK                    -> microseconds of host time since start
+ *
+ * Guest fds 0, 1 and 2 are stdin, stdout and stderr of TEMU.
+ */
+#define SEMIHOST_INSTR 0x4a800000
+#define SEMIHOST_RS 0x14
+
+enum { SH_OPEN = 1, SH_READ, SH_WRITE, SH_CLOSE, SH_EXIT, SH_CLOCK };
+
+/* flags of SH_OPEN, independent of the host */
+#define SH_O_RDONLY 0x0
+#define SH_O_WRONLY 0x1
+#define SH_O_RDWR 0x2
+#define SH_O_CREAT 0x100
+#define SH_O_TRUNC 0x200
+#define SH_O_APPEND 0x400
+
+/* Perform the call requested by the registers, return the result. */
+uint32_t semihost_call();
+
+/* Close the files left open by the last run. */
+void semihost_reset();
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __UART_H__
+#define __UART_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* The UART of the SoC (async_transmitter/async_receiver, 8N1), at guest
+ * address 0xbfd003f8:
+ *   +0 data    write: send a byte, read: the received byte
+ *   +4 status  bit 0: transmitter idle (~TxD_busy)
+ *              bit 1: a received byte is available (RxD_data_ready)
+ */
+#define UART_BASE 0x3fd003f8
+#define UART_DATA 0x0
+#define UART_STATUS 0x4
+#define UART_SIZE 0x8
+
+#define UART_TX_IDLE 0x1
+#define UART_RX_READY 0x2
+
+void init_uart();
+
+/* The guest reads its input from `filename', or from a new pty whose
+ * slave also receives the output. Return false on failure.
+ */
+bool uart_input_file(const char *filename);
+bool uart_open_pty();
+
+void uart_flush();
+
+/* Also copy the output to `fp', or stop copying if it is NULL. */
+void uart_capture(FILE *fp);
+
+#endif
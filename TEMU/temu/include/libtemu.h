@@ -0,0 +1,144 @@
+#ifndef __LIBTEMU_H__
+#define __LIBTEMU_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* TEMU as a library (make lib: build/libtemu.a and build/libtemu.so),
+ * without the monitor, readline or GTK. The machine state of TEMU is
+ * global, so there is at most one machine per process.
+ *
+ * Addresses are guest addresses, the high bit is dropped as by the CPU.
+ * Functions returning int return 0 on success and -1 on failure, unless
+ * stated otherwise.
+ */
+
+#define TEMU_API_VERSION 1
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct temu temu_t;
+
+/* index of the registers in temu_read_regs()/temu_write_regs() */
+enum { TEMU_REG_HI = 32, TEMU_REG_LO, TEMU_REG_PC, TEMU_NR_REGS };
+
+/* why temu_run() returned */
+enum {
+	TEMU_STOP_COUNT,	/* the requested number of instructions ran */
+	TEMU_STOP_CALLBACK,	/* a callback asked to stop */
+	TEMU_STOP_END		/* the guest hit a trap or called SH_EXIT */
+};
+
+/* A register write of the golden trace, `pc' is physical. Return
+ * nonzero to stop temu_run() after the current instruction.
+ */
+typedef int (*temu_trace_cb)(void *user, uint32_t pc, uint32_t reg, uint32_t value);
+
+/* The guest ended, `code' is 0 for the good trap, 1 for the bad trap,
+ * or the value passed to SH_EXIT.
+ */
+typedef void (*temu_trap_cb)(void *user, int code);
+
+/* accesses of a device mapped by temu_map_mmio(), `offset' is relative
+ * to the start of the region and `len' is 1, 2 or 4
+ */
+typedef uint32_t (*temu_mmio_read_cb)(void *user, uint32_t offset, uint32_t len);
+typedef void (*temu_mmio_write_cb)(void *user, uint32_t offset, uint32_t len, uint32_t data);
+
+int temu_api_version();
+
+/* Create the machine, reset with empty memory. Return NULL if there is
+ * one already.
+ */
+temu_t *temu_create();
+void temu_destroy(temu_t *t);
+
+/* Reset the CPU, coprocessor 0 and the devices. The memory is kept, the
+ * pc is 0x80000000.
+ */
+void temu_reset(temu_t *t);
+
+/* Copy a raw binary to `addr', or the loadable segments of a 32-bit
+ * little-endian MIPS ELF file to their addresses. The ELF loader also
+ * sets the pc to the entry point.
+ */
+int temu_load_binary(temu_t *t, const char *path, uint32_t addr);
+int temu_load_elf(temu_t *t, const char *path);
+
+/* Run at most `n' instructions, UINT64_MAX for no limit. The number of
+ * instructions executed is stored in `*executed' if it is not NULL.
+ * Return one of TEMU_STOP_*.
+ */
+int temu_run(temu_t *t, uint64_t n, uint64_t *executed);
+
+/* the exit code of the guest if it has ended, otherwise -1 */
+int temu_exit_code(temu_t *t);
+uint64_t temu_instr_count(temu_t *t);
+
+/* GPRs 0-31, hi, lo and pc */
+void temu_read_regs(temu_t *t, uint32_t regs[TEMU_NR_REGS]);
+void temu_write_regs(temu_t *t, const uint32_t regs[TEMU_NR_REGS]);
+uint32_t temu_read_cp0(temu_t *t, int reg);
+void temu_write_cp0(temu_t *t, int reg, uint32_t value);
+
+/* Bulk copies between the guest memory and `buf'. DRAM is copied
+ * directly, device registers are accessed byte by byte.
+ */
+int temu_read_mem(temu_t *t, uint32_t addr, void *buf, size_t len);
+int temu_write_mem(temu_t *t, uint32_t addr, const void *buf, size_t len);
+
+/* Disassemble `instr' at `pc' without executing it. */
+void temu_disasm(uint32_t pc, uint32_t instr, char *buf, size_t size);
+
+/* Set the callback, NULL to remove it. */
+void temu_on_trace(temu_t *t, temu_trace_cb cb, void *user);
+void temu_on_trap(temu_t *t, temu_trap_cb cb, void *user);
+
+/* Map a device of the client to [addr, addr + size). */
+int temu_map_mmio(temu_t *t, const char *name, uint32_t addr, uint32_t size,
+		temu_mmio_read_cb read, temu_mmio_write_cb write, void *user);
+
+/* Lockstep checking against the RTL. The testbench calls
+ * temu_difftest_check() on every writeback of the CPU, i.e. when
+ * debug_wb_rf_wen is set and debug_wb_rf_wnum is not 0, and stops at the
+ * first divergence:
+ *
+ *   import "DPI-C" function void temu_difftest_init();
+ *   import "DPI-C" function int temu_difftest_check(input int unsigned pc,
+ *       input int unsigned wnum, input int unsigned wdata);
+ *
+ *   always @(posedge cpu_clk)
+ *       if(debug_wb_rf_wen && debug_wb_rf_wnum != 5'd0)
+ *           if(temu_difftest_check(debug_wb_pc, debug_wb_rf_wnum, debug_wb_rf_wdata) != 0)
+ *               $finish;
+ *
+ * Like the golden trace, pc is physical: the high 3 bits are ignored.
+ * Writes to $0 are skipped since the RTL does not report them.
+ */
+
+enum { TEMU_DIFFTEST_OK, TEMU_DIFFTEST_MISMATCH, TEMU_DIFFTEST_END };
+
+/* Load inst.bin and data.bin from the current directory and reset the
+ * machine. No log.txt or golden_trace.txt is written.
+ */
+void temu_difftest_init();
+
+/* Run until the next register write. Return 1 and fill in the write, or
+ * 0 when the program ended before writing a register.
+ */
+int temu_difftest_step(uint32_t *pc, uint32_t *wnum, uint32_t *wdata);
+
+/* Run to the next register write and compare it with the one of the DUT.
+ * A mismatch is reported on stderr.
+ */
+int temu_difftest_check(uint32_t pc, uint32_t wnum, uint32_t wdata);
+
+/* number of instructions TEMU executed */
+uint64_t temu_difftest_instr_count();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,4 +10,13 @@ extern uint8_t *hw_mem;
 uint32_t mem_read(uint32_t, size_t);
 void mem_write(uint32_t, size_t, uint32_t);
 
+/* Drop the row buffers over [addr, addr + len) after hw_mem was written directly. */
+void dram_invalidate(uint32_t addr, size_t len);
+
+/* Run the accesses through the row buffers of the DDR3 model (the
+ * default), or go to the array directly, e.g. to fast-forward.
+ */
+extern bool dram_model;
+void dram_set_model(bool on);
+
 #endif
@@ -0,0 +1,23 @@
+#ifndef __FORKSERVER_H__
+#define __FORKSERVER_H__
+
+#include "common.h"
+
+/* A fork server: TEMU is initialised and the image loaded once, then every
+ * request runs in a copy-on-write child forked from this state, so that a
+ * run does not pay for the start of TEMU.
+ *
+ * A request is one line of monitor commands, as for `temu -e', e.g. "c"
+ * or "c; info metrics". The child writes its output to the client, then
+ * the server adds a line "exit N" with the exit code of the run (see
+ * monitor.h, 128 + the signal if the child was killed). log.txt and the
+ * golden trace hold the latest run. The requests are run one at a time.
+ *
+ * `path' is a Unix socket, served until SIGINT or SIGTERM, or "-" for
+ * requests on the standard input and responses on the standard output,
+ * served until the end of the input. Every run is stopped after `timeout'
+ * seconds if it is not 0. Return false if the socket can not be opened.
+ */
+bool fork_server(const char *path, unsigned timeout);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __MODE_H__
+#define __MODE_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* Execution modes. The detailed mode (the default) runs every instruction
+ * through the DDR3 row-buffer model, the golden trace, log.txt, the
+ * watchpoints and the observers (timing, cache, bpred, ...). The
+ * fast-forward mode runs the bare interpreter with none of them, e.g. to
+ * skip the boot of a program before looking at one region in detail.
+ *
+ * The machine is the same in both modes: the devices, timers and
+ * interrupts run as usual, the row buffers are dropped when the DDR3 model
+ * comes back, and the watchpoints take their current values. The golden
+ * trace and log.txt only cover the detailed parts of the run, and reverse
+ * execution is turned off by the first fast-forward.
+ */
+extern bool fast_forward;
+
+void mode_set(bool fast);
+
+/* Switch before the instruction at `pc' (virtual) runs, or after `when'
+ * instructions (see nr_instr), once. A new trigger of the same kind
+ * replaces the old one.
+ */
+#define MODE_NO_PC 1	/* not an instruction address */
+extern uint32_t mode_pc;
+void mode_at_pc(uint32_t pc, bool fast);
+void mode_at_instr(uint64_t when, bool fast);
+
+/* mode_pc was reached, called by cpu_exec() */
+void mode_pc_reached();
+
+/* Has the run fast-forwarded, i.e. is the golden trace partial? */
+bool mode_fast_forwarded();
+
+/* instructions run in the fast-forward mode so far, out of nr_instr */
+uint64_t mode_fast_instructions();
+
+void mode_report(FILE *fp);
+
+#endif
@@ -3,17 +3,57 @@
 
 #include "common.h"
 
+#include <signal.h>
+
 enum { STOP, RUNNING, END };
 extern int temu_state;
 
+/* When temu_state is END: 0 after the good trap, 1 after the bad trap,
+ * or the code the guest passed to SH_EXIT.
+ */
+extern int guest_exit_code;
+
+/* Set when the guest read from the host: UART input, semihosting other
+ * than SH_EXIT, or switches set from the monitor. The result of such a
+ * run does not follow from the image alone.
+ */
+extern bool guest_touched_host;
+
+/* number of instructions executed since TEMU started */
+extern uint64_t nr_instr;
+
 void display_reg();
 void init_monitor(int argc, char *argv[]);
+void init_machine();
+void reset_machine();
 void restart();
 void ui_mainloop();
+
+/* Headless runs: the commands of a script (see ui.c) and a timeout in
+ * seconds of wall time, after which the guest is stopped.
+ */
+void ui_run_script(const char *script);
+void ui_set_timeout(unsigned seconds);
+bool ui_timed_out();
+
+/* Set by the timeout. cpu_exec() checks it before every instruction
+ * and then runs nothing more.
+ */
+extern volatile sig_atomic_t timed_out;
+
+/* The exit code of a headless run: guest_exit_code if the guest has
+ * ended, or one of these.
+ */
+#define EXIT_NOT_ENDED 2
+#define EXIT_TIMEOUT 124
+int ui_exit_code();
 void cpu_exec(uint32_t n);
+void init_cpu_metrics();
 
 void init_trace();
 void close_trace();
 void record_trace(uint32_t pc, int reg_num, uint32_t value);
+void output_offsets(long *trace_off, long *log_off);
+void output_rewind(long trace_off, long log_off);
 
 #endif
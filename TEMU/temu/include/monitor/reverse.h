@@ -0,0 +1,69 @@
+#ifndef __REVERSE_H__
+#define __REVERSE_H__
+
+#include "common.h"
+
+/* Reverse execution (`rsi N' and `rc'). The machine is checkpointed
+ * every `interval' instructions by an event: the registered state (CPU,
+ * coprocessor 0, pending events, devices) is copied, and the old contents
+ * of a page of DRAM are saved the first time it is written after the
+ * checkpoint. Going back restores the nearest checkpoint before the
+ * target and runs forward to it again, which gives the same machine
+ * because the run only depends on the image as long as the guest has not
+ * read from the host (see guest_touched_host).
+ *
+ * The saved pages are bounded by REVERSE_BUDGET, beyond it every other
+ * checkpoint is dropped and the interval is doubled.
+ */
+#define REVERSE_INTERVAL 100000
+#define REVERSE_BUDGET (256u << 20)
+
+/* the pages of DRAM, 4KB each */
+#define REVERSE_NR_PAGES (0x20000000 >> 12)
+
+/* checkpoints are only taken when set, by the monitor */
+extern bool reverse_enabled;
+
+/* Set while the history is run again: the devices do not output to the
+ * host and cpu_exec() does not print the instructions.
+ */
+extern bool replaying;
+
+/* pages written since the latest checkpoint */
+extern uint8_t reverse_dirty[REVERSE_NR_PAGES];
+
+/* Save `size' bytes at `ptr' in every checkpoint, for the state of the
+ * machine outside of DRAM. Registering the same `ptr' again is ignored.
+ */
+void reverse_register(void *ptr, size_t size);
+
+/* Drop the history and take the first checkpoint, after the machine was reset. */
+void reverse_reset();
+
+/* Drop the history and take no more checkpoints, e.g. for a long run. */
+void reverse_disable();
+
+/* Keep the page of `paddr', it is about to be written. */
+void reverse_save_page(uint32_t paddr);
+
+/* DRAM is written at [paddr, paddr + len) */
+static inline void reverse_write(uint32_t paddr, size_t len) {
+	uint32_t page;
+	if(!reverse_enabled) { return; }
+	page = paddr >> 12;
+	if(page < REVERSE_NR_PAGES && !reverse_dirty[page]) { reverse_save_page(paddr); }
+	page = (paddr + len - 1) >> 12;
+	if(page < REVERSE_NR_PAGES && !reverse_dirty[page]) { reverse_save_page(paddr + len - 1); }
+}
+
+/* Go back `n' instructions, return false if that is before the history
+ * or the run can not be repeated.
+ */
+bool reverse_step(uint64_t n);
+
+/* Go back to the latest change of a watchpoint, or to the start of the
+ * history if there is none. Return false if the run can not be repeated.
+ */
+bool reverse_continue();
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "common.h"
+
+/* The golden trace is golden_trace.txt, one "%08x  %02d          %08x"
+ * line per register write after a header line, or with --trace-binary
+ * golden_trace.bin: TRACE_MAGIC followed by packed little-endian
+ * TraceRecords, which is much cheaper to write and to compare.
+ */
+#define TRACE_MAGIC "TEMUTRC1"
+#define TRACE_MAGIC_LEN 8
+
+typedef struct {
+	uint32_t pc, reg, value;
+} TraceRecord;
+
+/* set before init_monitor() */
+extern bool trace_binary;
+
+void flush_trace();
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __TRACECACHE_H__
+#define __TRACECACHE_H__
+
+#include "common.h"
+
+/* A cache of finished runs, so that a regression that runs the same
+ * program again does not emulate it again. The key is a hash of
+ * inst.bin and data.bin, TEMU_VERSION and the trace options, the entry
+ * DIR/<key>.gz holds the final CPU state, the UART output and the golden
+ * trace, compressed with zlib.
+ *
+ * A run is stored when it reached a trap and the guest did not read
+ * anything from the host (see guest_touched_host). Memory is not part of
+ * an entry: after a hit, `x' shows the initial image. main() does not
+ * use the cache with the analysis and mode options (--profile, --bbv,
+ * --simpoints, --fast-forward, --detail-at*), which need a real run.
+ */
+
+#ifndef TEMU_VERSION
+#define TEMU_VERSION "unknown"
+#endif
+
+/* Use the cache in `dir', created if needed. Call before restart(). */
+bool trace_cache_open(const char *dir);
+
+/* After restart(): if the image is in the cache, write the golden trace,
+ * restore the final state, replay the UART output and return true, the
+ * program has then ended without being executed.
+ */
+bool trace_cache_load();
+
+/* At exit: store the run if it is complete and cacheable. */
+void trace_cache_store();
+
+#endif
@@ -20,4 +20,19 @@ WP* find_wp(int NO);
 bool check_wp();
 void list_wp();
 
+/* Is any watchpoint set? */
+bool wp_active();
+
+/* While the history is run again (see reverse.h) the watchpoints are
+ * checked without printing the changes, or not checked at all.
+ */
+enum { WP_ON, WP_QUIET, WP_OFF };
+void wp_set_mode(int mode);
+
+/* Take the current values as the old ones, after the machine went back. */
+void wp_rebase();
+
+/* number of times check_wp() found a change */
+uint64_t wp_hits();
+
 #endif
@@ -0,0 +1,20 @@
+#ifndef __BPRED_H__
+#define __BPRED_H__
+
+#include "common.h"
+#include <stdio.h>
+
+enum { BP_NOT_TAKEN, BP_BTFN, BP_BIMODAL, BP_GSHARE, BP_BTB, NR_BP };
+
+/* Look up a predictor by its name ("nt", "btfn", "bimodal", "gshare", "btb"). */
+int bpred_find(const char *name);
+
+/* Start simulating predictor `kind' with 2^`log_size' table entries
+ * (ignored by the static predictors). All enabled predictors observe
+ * the same branches, so they can be compared in one run.
+ */
+bool bpred_enable(int kind, int log_size);
+void bpred_disable(int kind);
+void bpred_report(FILE *fp);
+
+#endif
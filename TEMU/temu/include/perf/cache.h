@@ -0,0 +1,26 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "common.h"
+#include <stdio.h>
+
+enum { REPL_LRU, REPL_PLRU, REPL_RANDOM };
+
+typedef struct {
+	uint32_t size;		/* total capacity in bytes */
+	uint32_t assoc;		/* ways per set */
+	uint32_t line_size;	/* bytes per line */
+	int repl;		/* replacement policy */
+	bool write_back;	/* write-back + write-allocate, or write-through + no-write-allocate */
+} CacheConfig;
+
+enum { ICACHE, DCACHE, NR_CACHE };
+
+/* Start simulating cache `which' (ICACHE or DCACHE) with `cfg'.
+ * Return false if the geometry is invalid.
+ */
+bool cache_enable(int which, const CacheConfig *cfg);
+void cache_disable(int which);
+void cache_report(FILE *fp);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* A registry of named run metrics. Subsystems define their metrics as
+ * static objects, register them once, and update them directly.
+ * Names are dotted paths such as "cpu.instructions" and must not change,
+ * dashboards read them from the JSON dump.
+ */
+
+enum { METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM };
+
+#define NR_METRIC_BUCKET 33	/* bucket i counts values in [2^(i-1), 2^i) */
+
+typedef struct metric {
+	const char *name;
+	const char *unit;
+	int type;
+
+	uint64_t count;		/* counter */
+	const uint64_t *ptr;	/* counter kept by the subsystem itself, if not NULL */
+	double (*read)();	/* gauge computed on demand */
+	double value;		/* gauge set by the subsystem */
+
+	uint64_t nr_sample, sum;	/* histogram */
+	uint64_t bucket[NR_METRIC_BUCKET];
+
+	struct metric *next;
+} Metric;
+
+void metric_register(Metric *m);
+void metric_observe(Metric *m, uint64_t v);
+uint64_t metric_counter_value(const Metric *m);
+double metric_gauge_value(const Metric *m);
+
+/* the registered metrics in order, NULL at the end */
+Metric *metrics_first();
+
+void metrics_dump_json(FILE *fp);
+bool metrics_write(const char *filename);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __OBSERVER_H__
+#define __OBSERVER_H__
+
+#include "common.h"
+
+/* An observer is notified about events of the guest execution, e.g. the
+ * retirement of an instruction. Observers are chained in a list. When no
+ * observer is registered, a hook costs only one test against NULL, so the
+ * analysis models can be compiled in and still cost nothing when off.
+ */
+typedef struct observer {
+	const char *name;
+
+	/* instruction fetch of the instruction at `pc' */
+	void (*fetch)(uint32_t pc);
+
+	/* data access issued by the instruction at `pc' */
+	void (*mem)(uint32_t pc, uint32_t addr, size_t len, bool is_write);
+
+	/* conditional branch at `pc' to `target' */
+	void (*branch)(uint32_t pc, uint32_t target, bool taken);
+
+	/* call (jal, jalr, taken bltzal/bgezal) at `pc' to `target', which
+	 * returns to pc + 8, and return (jr $ra) at `pc' to `target'
+	 */
+	void (*call)(uint32_t pc, uint32_t target);
+	void (*ret)(uint32_t pc, uint32_t target);
+
+	/* `npc' is the address of the next instruction to be executed. */
+	void (*retire)(uint32_t pc, uint32_t instr, uint32_t npc);
+
+	/* register write recorded in the golden trace, `pc' is physical */
+	void (*writeback)(uint32_t pc, int reg, uint32_t value);
+
+	struct observer *next;
+} Observer;
+
+extern Observer *observers;
+
+void register_observer(Observer *obs);
+void unregister_observer(Observer *obs);
+
+/* Does an observer look at single instructions, i.e. at more than the
+ * register writes?
+ */
+bool observers_see_instr();
+
+/* Stop notifying the observers, e.g. to fast-forward, and start again.
+ * Observers registered in between are notified after the resume.
+ */
+void observers_suspend();
+void observers_resume();
+
+#define notify_observers(event, ...) \
+	do { \
+		if(observers != NULL) { \
+			Observer *__obs; \
+			for(__obs = observers; __obs != NULL; __obs = __obs->next) { \
+				if(__obs->event) { __obs->event(__VA_ARGS__); } \
+			} \
+		} \
+	} while(0)
+
+#endif
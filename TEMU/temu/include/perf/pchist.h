@@ -0,0 +1,29 @@
+#ifndef __PCHIST_H__
+#define __PCHIST_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* A fixed-size histogram of event counts per pc, e.g. misses.
+ * Pcs which do not fit any more are only counted in `dropped'.
+ */
+
+#define NR_PCHIST 1024		/* must be a power of 2 */
+
+typedef struct {
+	uint32_t pc;
+	uint64_t count;
+} PCCount;
+
+typedef struct {
+	PCCount entry[NR_PCHIST];
+	uint64_t dropped;
+} PCHist;
+
+void pchist_reset(PCHist *h);
+void pchist_add(PCHist *h, uint32_t pc);
+
+/* print the `n' most frequent pcs, each line prefixed by `label' */
+void pchist_print_top(PCHist *h, FILE *fp, int n, const char *label);
+
+#endif
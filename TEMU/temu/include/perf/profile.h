@@ -0,0 +1,29 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* A call-graph profiler of the guest. It keeps a shadow call stack (a
+ * call pushes a frame, jr $ra pops it) and charges the instructions
+ * retired in between to the function on top, so it costs nothing per
+ * instruction and O(1) per call and return. Functions are named by the
+ * symbol table of the ELF file of the program, addresses outside of any
+ * symbol are charged to "[unknown]".
+ */
+
+/* Start profiling, with the symbols of `elf' if it is not NULL. Return
+ * false if `elf' can not be read.
+ */
+bool profile_enable(const char *elf);
+void profile_disable();
+
+/* the functions with the most inclusive instructions */
+void profile_report(FILE *fp);
+
+/* The call graph in the callgrind format, for kcachegrind,
+ * callgrind_annotate or gprof2dot.
+ */
+bool profile_write_callgrind(const char *filename);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __SIMPOINT_H__
+#define __SIMPOINT_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* Sampled simulation in the way of SimPoint. The run is cut into
+ * intervals of `interval' instructions, counted from the start.
+ *
+ * A first run writes the basic-block vector of every interval: how many
+ * instructions it ran in each basic block, where a block starts at the
+ * target of a taken branch, jump or exception and ends at the next one.
+ * tools/simpoint.c clusters the vectors and picks the interval closest to
+ * the center of each cluster, weighted by the size of the cluster.
+ *
+ * A second run fast-forwards between the picked intervals (see mode.h:
+ * no DDR3 model, observers, golden trace or log), and runs only the
+ * picked intervals in detail. Every counter metric is then estimated for
+ * the whole run from the weighted picked intervals.
+ */
+#define SIMPOINT_INTERVAL 1000000
+
+/* Write the vectors in the SimPoint .bb format, one "T:id:count ..." line
+ * per interval. A last interval that is not full is not written.
+ */
+bool bbv_enable(const char *filename, uint64_t interval);
+void bbv_disable();
+
+/* Run only the intervals in `prefix'.simpoints in detail, weighted by
+ * `prefix'.weights (written by tools/simpoint.c with the same interval).
+ * Return false if the files can not be read.
+ */
+bool sample_enable(const char *prefix, uint64_t interval);
+
+/* the estimates of the counters, and the error of the estimate of the
+ * DRAM accesses, which are also counted during the fast-forward
+ */
+void sample_report(FILE *fp);
+
+#endif
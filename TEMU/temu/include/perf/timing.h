@@ -0,0 +1,35 @@
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+#include "common.h"
+#include <stdio.h>
+
+/* Stages of the MiniMIPS32_Lite pipeline. */
+enum { TM_IF, TM_ID, TM_EX, TM_MEM, TM_WB, NR_TM_STAGE };
+
+/* Every modelled cycle is accounted to exactly one of these classes. */
+enum { TM_RETIRE, TM_FETCH, TM_BRANCH, TM_MEMORY, TM_MULTICYCLE, NR_TM_CLASS };
+
+typedef struct {
+	bool forwarding;	/* bypass from EX/MEM and MEM/WB into EX (and ID for branches) */
+	int branch_stage;	/* TM_ID or TM_EX, the stage which resolves branches and jumps */
+	int ifetch_wait;	/* wait states of the instruction memory */
+	int dmem_wait;		/* wait states of the data memory */
+	int mul_latency;	/* EX cycles of mult/multu */
+	int div_latency;	/* EX cycles of div/divu */
+} TimingConfig;
+
+extern TimingConfig timing_config;
+
+void timing_enable(bool enable);
+bool timing_enabled();
+void timing_reset();
+void timing_report(FILE *fp);
+
+/* Export the stage timestamps of `count' instructions, starting from the
+ * `start'-th instruction retired after the last reset, in Kanata format.
+ */
+bool timing_kanata(const char *filename, uint64_t start, uint64_t count);
+void timing_kanata_close();
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __ZONE_H__
+#define __ZONE_H__
+
+#include "common.h"
+
+/* Instrumentation zones of the emulator itself, written as Chrome
+ * trace-event JSON which can be opened in Perfetto or chrome://tracing.
+ * When tracing is off, entering and leaving a zone costs one test.
+ */
+
+extern bool zone_enabled;
+
+bool zone_open(const char *filename);
+void zone_close();
+uint64_t zone_now();
+void zone_emit(const char *name, uint64_t start);
+
+typedef struct {
+	const char *name;
+	uint64_t start;
+} Zone;
+
+static inline void zone_leave(Zone *z) {
+	if(z->start != 0) { zone_emit(z->name, z->start); }
+}
+
+/* Trace the rest of the enclosing scope as a zone called `name'. */
+#define ZONE(name) \
+	Zone concat(__zone_, __LINE__) __attribute__((cleanup(zone_leave))) = \
+		{ name, zone_enabled ? zone_now() : 0 }
+
+#endif
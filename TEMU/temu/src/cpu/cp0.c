@@ -0,0 +1,148 @@
+#include "temu.h"
+#include "monitor.h"
+#include "cp0.h"
+#include "device/event.h"
+#include "monitor/reverse.h"
+#include "perf/metrics.h"
+
+/* Count advances once per retired instruction. It is not updated on
+ * every instruction but derived from nr_instr, and a Count/Compare match
+ * is an event scheduled for the instruction count at which it happens.
+ * Pending interrupts are taken through an event as well, so the
+ * execution loop never polls the interrupt state.
+ */
+
+static uint32_t count_base;
+static uint64_t count_epoch;
+static bool irq_scheduled;
+
+static Metric m_exceptions = { .name = "cpu.exceptions", .unit = "exceptions", .type = METRIC_COUNTER };
+static Metric m_interrupts = { .name = "cpu.interrupts", .unit = "interrupts", .type = METRIC_COUNTER };
+
+static uint32_t count_now() {
+	return count_base + (uint32_t)(nr_instr - count_epoch);
+}
+
+static bool irq_deliverable() {
+	uint32_t status = cpu.cp0[CP0_STATUS];
+	return (status & STATUS_IE) && !(status & STATUS_EXL) &&
+		(cpu.cp0[CP0_CAUSE] & status & CAUSE_IP_MASK);
+}
+
+static void take_interrupt(void *arg) {
+	irq_scheduled = false;
+	if(irq_deliverable()) {
+		m_interrupts.count ++;
+		/* between two instructions, cpu.pc is the next one to execute */
+		cpu.pc = raise_exception(EXC_INT, cpu.pc);
+	}
+}
+
+static void check_irq() {
+	if(!irq_scheduled && irq_deliverable()) {
+		irq_scheduled = true;
+		event_schedule(nr_instr, take_interrupt, NULL);
+	}
+}
+
+static void timer_fire(void *arg);
+
+static void timer_schedule() {
+	uint32_t delta = cpu.cp0[CP0_COMPARE] - count_now();
+	event_cancel(timer_fire, NULL);
+	event_schedule(nr_instr + (delta ? delta : (1ull << 32)), timer_fire, NULL);
+}
+
+static void timer_fire(void *arg) {
+	cpu.cp0[CP0_CAUSE] |= CAUSE_IP(TIMER_IRQ_LINE) | CAUSE_TI;
+	timer_schedule();
+	check_irq();
+}
+
+uint32_t cp0_read(int reg) {
+	return reg == CP0_COUNT ? count_now() : cpu.cp0[reg];
+}
+
+void cp0_write(int reg, uint32_t val) {
+	switch(reg) {
+		case CP0_COUNT:
+			count_base = val;
+			count_epoch = nr_instr;
+			timer_schedule();
+			break;
+		case CP0_COMPARE:
+			cpu.cp0[CP0_COMPARE] = val;
+			/* writing Compare acknowledges the timer interrupt */
+			cpu.cp0[CP0_CAUSE] &= ~(CAUSE_IP(TIMER_IRQ_LINE) | CAUSE_TI);
+			timer_schedule();
+			break;
+		case CP0_CAUSE:
+			/* only the two software interrupts are writable */
+			cpu.cp0[CP0_CAUSE] = (cpu.cp0[CP0_CAUSE] & ~(CAUSE_IP(0) | CAUSE_IP(1))) |
+				(val & (CAUSE_IP(0) | CAUSE_IP(1)));
+			check_irq();
+			break;
+		case CP0_STATUS:
+			cpu.cp0[CP0_STATUS] = val;
+			check_irq();
+			break;
+		default:
+			cpu.cp0[reg] = val;
+	}
+}
+
+void cp0_set_irq(int line, bool level) {
+	assert(line >= 2 && line < 8);
+	if(level) { cpu.cp0[CP0_CAUSE] |= CAUSE_IP(line); }
+	else { cpu.cp0[CP0_CAUSE] &= ~CAUSE_IP(line); }
+	check_irq();
+}
+
+uint32_t raise_exception(int exccode, uint32_t epc) {
+	if(!(cpu.cp0[CP0_STATUS] & STATUS_EXL)) {
+		if(cpu.delay_slot) {
+			cpu.cp0[CP0_EPC] = epc - 4;
+			cpu.cp0[CP0_CAUSE] |= CAUSE_BD;
+		}
+		else {
+			cpu.cp0[CP0_EPC] = epc;
+			cpu.cp0[CP0_CAUSE] &= ~CAUSE_BD;
+		}
+	}
+	/* the branch is executed again after eret */
+	cpu.delay_slot = false;
+	cpu.cp0[CP0_CAUSE] = (cpu.cp0[CP0_CAUSE] & ~CAUSE_EXC_MASK) | (exccode << CAUSE_EXC_SHIFT);
+	cpu.cp0[CP0_STATUS] |= STATUS_EXL;
+	m_exceptions.count ++;
+	return EXC_VECTOR;
+}
+
+uint32_t cp0_eret() {
+	cpu.cp0[CP0_STATUS] &= ~STATUS_EXL;
+	check_irq();
+	return cpu.cp0[CP0_EPC];
+}
+
+void cp0_report(FILE *fp) {
+	fprintf(fp, "count\t\t0x%08x\n", cp0_read(CP0_COUNT));
+	fprintf(fp, "compare\t\t0x%08x\n", cpu.cp0[CP0_COMPARE]);
+	fprintf(fp, "status\t\t0x%08x\n", cpu.cp0[CP0_STATUS]);
+	fprintf(fp, "cause\t\t0x%08x\n", cpu.cp0[CP0_CAUSE]);
+	fprintf(fp, "epc\t\t0x%08x\n", cpu.cp0[CP0_EPC]);
+}
+
+void init_cp0() {
+	memset(cpu.cp0, 0, sizeof(cpu.cp0));
+	cpu.delay_slot = false;
+	count_base = 0;
+	count_epoch = nr_instr;
+	irq_scheduled = false;
+	timer_schedule();
+
+	metric_register(&m_exceptions);
+	metric_register(&m_interrupts);
+
+	reverse_register(&count_base, sizeof(count_base));
+	reverse_register(&count_epoch, sizeof(count_epoch));
+	reverse_register(&irq_scheduled, sizeof(irq_scheduled));
+}
@@ -0,0 +1,55 @@
+#include "disasm.h"
+#include "isa.h"
+#include "reg.h"
+
+#include <stdio.h>
+
+/* The disassembler, generated from the ISA table like the interpreter,
+ * for the log and for tools that look at instructions which are not
+ * executed, e.g. tracediff.
+ */
+
+typedef struct {
+	const char *name;
+	int format;
+} DisasmEntry;
+
+static const DisasmEntry isa_disasm[NR_ISA_INSTR] = {
+#define ISA_DISASM(id, name, index, format) [I_##id] = { name, format },
+	ISA_TABLE(ISA_DISASM)
+#undef ISA_DISASM
+};
+
+void disasm(uint32_t pc, uint32_t instr, char *buf, size_t size) {
+	int rs = isa_rs(instr), rt = isa_rt(instr), rd = isa_rd(instr), sa = isa_sa(instr);
+	uint32_t imm = isa_imm(instr);
+	int32_t simm = isa_simm(instr);
+	uint32_t branch = isa_branch_target(pc, instr);
+	int id = isa_decode(instr);
+	const DisasmEntry *e = &isa_disasm[id];
+
+	if(id == I_INVALID) {
+		snprintf(buf, size, "invalid   0x%08x", instr);
+		return;
+	}
+
+	switch(e->format) {
+		case F_NONE: snprintf(buf, size, "%s", e->name); break;
+		case F_RD_RS_RT: snprintf(buf, size, "%s   %s,   %s,   %s", e->name, regfile[rd], regfile[rs], regfile[rt]); break;
+		case F_RD_RT_SA: snprintf(buf, size, "%s   %s,   %s,   %d", e->name, regfile[rd], regfile[rt], sa); break;
+		case F_RD_RT_RS: snprintf(buf, size, "%s   %s,   %s,   %s", e->name, regfile[rd], regfile[rt], regfile[rs]); break;
+		case F_RS: snprintf(buf, size, "%s   %s", e->name, regfile[rs]); break;
+		case F_RD: snprintf(buf, size, "%s   %s", e->name, regfile[rd]); break;
+		case F_RS_RT: snprintf(buf, size, "%s   %s,   %s", e->name, regfile[rs], regfile[rt]); break;
+		case F_RD_RS: snprintf(buf, size, "%s   %s,   %s", e->name, regfile[rd], regfile[rs]); break;
+		case F_RT_RS_IMM: snprintf(buf, size, "%s   %s,   %s,   0x%04x", e->name, regfile[rt], regfile[rs], imm); break;
+		case F_RT_IMM: snprintf(buf, size, "%s   %s,   0x%04x", e->name, regfile[rt], imm); break;
+		case F_RT_MEM: snprintf(buf, size, "%s   %s,   %d(%s)", e->name, regfile[rt], simm, regfile[rs]); break;
+		case F_RS_RT_BRANCH: snprintf(buf, size, "%s   %s,   %s,   0x%08x", e->name, regfile[rs], regfile[rt], branch); break;
+		case F_RS_BRANCH: snprintf(buf, size, "%s   %s,   0x%08x", e->name, regfile[rs], branch); break;
+		case F_RS_SIMM: snprintf(buf, size, "%s   %s,   %d", e->name, regfile[rs], simm); break;
+		case F_JUMP: snprintf(buf, size, "%s   0x%08x", e->name, isa_jump_target(pc, instr)); break;
+		case F_CACHE: snprintf(buf, size, "%s   0x%02x,   %d(%s)", e->name, rt, simm, regfile[rs]); break;
+		case F_RT_CP0: snprintf(buf, size, "%s   %s,   $%d", e->name, regfile[rt], rd); break;
+	}
+}
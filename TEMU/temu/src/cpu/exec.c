@@ -1,61 +1,541 @@
 #include "helper.h"
-#include "all-instr.h"
+#include "monitor.h"
+#include "isa.h"
+#include "fusion.h"
+#include "perf/metrics.h"
+#include "device/semihost.h"
 
-typedef void (*op_fun)(uint32_t);
-static make_helper(_2byte_esc);
+/* The interpreter. exec() decodes an instruction with the ISA table (see
+ * isa.h) and switches to the EXEC() body of the instruction, which the
+ * compiler inlines, so an instruction costs no call. `pc' is the physical
+ * address of the instruction, cpu.pc its virtual address.
+ */
 
-Operands ops_decoded;
 uint32_t instr;
-	
-
-/* TODO: Add more instructions!!! */
-
-op_fun opcode_table [64] = {
-/* 0x00 */	_2byte_esc, inv, inv, inv,
-/* 0x04 */	beq, bne, blez, inv,
-/* 0x08 */	inv, addiu, inv, inv,
-/* 0x0c */	andi, ori, inv, lui,
-/* 0x10 */	inv, inv, temu_trap, inv,
-/* 0x14 */	inv, inv, inv, inv,
-/* 0x18 */	inv, inv, inv, inv,
-/* 0x1c */	inv, inv, inv, inv,
-/* 0x20 */	lb, inv, inv, lw,
-/* 0x24 */	inv, inv, inv, inv,
-/* 0x28 */	sb, inv, inv, sw,
-/* 0x2c */	inv, inv, inv, inv,
-/* 0x30 */	inv, inv, inv, inv,
-/* 0x34 */	inv, inv, inv, inv,
-/* 0x38 */	inv, inv, inv, inv,
-/* 0x3c */	inv, inv, inv, inv
+
+#define EXEC(id) static inline void exec_##id(uint32_t pc, uint32_t instr)
+
+#define RS reg_w(isa_rs(instr))
+#define RT reg_w(isa_rt(instr))
+
+/* Write a GPR and record it in the golden trace. */
+static inline void write_gpr(uint32_t pc, int reg, uint32_t value) {
+	reg_w(reg) = value;
+	record_trace(pc, reg, value);
+}
+
+/* invalid opcode */
+static void inv(uint32_t pc) {
+
+	uint32_t temp;
+	temp = instr_fetch(pc, 4);
+
+	uint8_t *p = (void *)&temp;
+	printf("invalid opcode(pc = 0x%08x): %02x %02x %02x %02x ...\n\n",
+			pc, p[3], p[2], p[1], p[0]);
+
+	printf("There are two cases which will trigger this unexpected exception:\n\
+1. The instruction at pc = 0x%08x is not implemented.\n\
+2. Something is implemented incorrectly.\n", pc);
+	printf("Find this pc value(0x%08x) in the disassembling result to distinguish which case it is.\n\n", pc);
+
+	assert(0);
+}
+
+/* Conditional branches: the delay slot executes in both directions,
+ * except after a branch-likely that is not taken, which skips it.
+ */
+static inline void cond_branch(uint32_t instr, bool taken, bool likely) {
+	uint32_t current_pc = cpu.pc;
+	uint32_t target = isa_branch_target(current_pc, instr);
+
+	if(taken) { delayed_branch(target); }
+	else if(likely) { cpu.pc += 4; }
+	else { delayed_branch(current_pc + 8); }
+	notify_observers(branch, current_pc, target, taken);
+}
+
+/* REGIMM branches and links: the condition is evaluated before $ra is
+ * written, bltzal $ra tests the old value
+ */
+static inline void link_branch(uint32_t pc, uint32_t instr, bool taken, bool likely) {
+	write_gpr(pc, R_RA, cpu.pc + 8);
+	cond_branch(instr, taken, likely);
+	if(taken) { notify_observers(call, cpu.pc, cpu.branch_target); }
+}
+
+static inline void trap_if(bool cond) {
+	if(cond) { throw_exception(EXC_TR); }
+}
+
+/* the address of a load or store */
+static inline uint32_t ls_addr(uint32_t instr) {
+	return RS + isa_simm(instr);
+}
+
+/* Misaligned loads and stores raise an address error. */
+static inline bool check_align(uint32_t addr, size_t len, int exccode) {
+	if(addr & (len - 1)) {
+		cpu.cp0[CP0_BADVADDR] = addr;
+		throw_exception(exccode);
+		return false;
+	}
+	return true;
+}
+
+/* madd, maddu, msub, msubu */
+static inline void mac(uint64_t prod, bool sub) {
+	uint64_t acc = ((uint64_t)cpu.hi << 32) | cpu.lo;
+	acc = sub ? acc - prod : acc + prod;
+	cpu.hi = acc >> 32;
+	cpu.lo = (uint32_t)acc;
+}
+
+static inline uint64_t smul(uint32_t a, uint32_t b) {
+	return (uint64_t)((int64_t)(int32_t)a * (int32_t)b);
+}
+
+/* signed overflow of a + b = result: both operands have the same sign,
+ * the result not
+ */
+static inline bool add_overflow(uint32_t a, uint32_t b, uint32_t result) {
+	return (~(a ^ b) & (a ^ result) & 0x80000000) != 0;
+}
+
+/* Operations with a register result, read the sources into `a' and `b'. */
+#define EXEC_RRR(id, expr) \
+	EXEC(id) { uint32_t a = RS, b = RT; write_gpr(pc, isa_rd(instr), (expr)); }
+#define EXEC_SHIFT(id, expr) \
+	EXEC(id) { uint32_t a = RT, b = isa_sa(instr); write_gpr(pc, isa_rd(instr), (expr)); }
+#define EXEC_SHIFTV(id, expr) \
+	EXEC(id) { uint32_t a = RT, b = RS & 0x1f; write_gpr(pc, isa_rd(instr), (expr)); }
+#define EXEC_IMM(id, expr) \
+	EXEC(id) { uint32_t a = RS, b = isa_imm(instr); write_gpr(pc, isa_rt(instr), (expr)); }
+#define EXEC_SIMM(id, expr) \
+	EXEC(id) { uint32_t a = RS, b = isa_simm(instr); write_gpr(pc, isa_rt(instr), (expr)); }
+
+/* arithmetic and logic */
+
+EXEC_RRR(addu, a + b)
+EXEC_RRR(subu, a - b)
+EXEC_RRR(and, a & b)
+EXEC_RRR(or, a | b)
+EXEC_RRR(xor, a ^ b)
+EXEC_RRR(nor, ~(a | b))
+EXEC_RRR(slt, (int32_t)a < (int32_t)b)
+EXEC_RRR(sltu, a < b)
+EXEC_RRR(mul, (uint32_t)smul(a, b))
+
+EXEC_SHIFT(sll, a << b)
+EXEC_SHIFT(srl, a >> b)
+EXEC_SHIFT(sra, (uint32_t)((int32_t)a >> b))
+EXEC_SHIFTV(sllv, a << b)
+EXEC_SHIFTV(srlv, a >> b)
+EXEC_SHIFTV(srav, (uint32_t)((int32_t)a >> b))
+
+EXEC_IMM(andi, a & b)
+EXEC_IMM(ori, a | b)
+EXEC_IMM(xori, a ^ b)
+EXEC_SIMM(addiu, a + b)
+EXEC_SIMM(slti, (int32_t)a < (int32_t)b)
+EXEC_SIMM(sltiu, a < b)
+
+EXEC(lui) { write_gpr(pc, isa_rt(instr), isa_imm(instr) << 16); }
+
+EXEC(add) {
+	uint32_t a = RS, b = RT, result = a + b;
+	if(add_overflow(a, b, result)) {
+		throw_exception(EXC_OV);
+		return;
+	}
+	write_gpr(pc, isa_rd(instr), result);
+}
+
+EXEC(sub) {
+	uint32_t a = RS, b = RT, result = a - b;
+	if(add_overflow(a, ~b, result)) {
+		throw_exception(EXC_OV);
+		return;
+	}
+	write_gpr(pc, isa_rd(instr), result);
+}
+
+EXEC(addi) {
+	uint32_t a = RS, b = isa_simm(instr), result = a + b;
+	if(add_overflow(a, b, result)) {
+		throw_exception(EXC_OV);
+		return;
+	}
+	write_gpr(pc, isa_rt(instr), result);
+}
+
+EXEC(movz) { if(RT == 0) { write_gpr(pc, isa_rd(instr), RS); } }
+EXEC(movn) { if(RT != 0) { write_gpr(pc, isa_rd(instr), RS); } }
+
+EXEC(clz) { uint32_t x = RS; write_gpr(pc, isa_rd(instr), x ? __builtin_clz(x) : 32); }
+EXEC(clo) { uint32_t x = ~RS; write_gpr(pc, isa_rd(instr), x ? __builtin_clz(x) : 32); }
+
+/* HI and LO */
+
+EXEC(mfhi) { write_gpr(pc, isa_rd(instr), cpu.hi); }
+EXEC(mflo) { write_gpr(pc, isa_rd(instr), cpu.lo); }
+EXEC(mthi) { cpu.hi = RS; }
+EXEC(mtlo) { cpu.lo = RS; }
+
+EXEC(mult) {
+	uint64_t result = smul(RS, RT);
+	cpu.hi = result >> 32;
+	cpu.lo = (uint32_t)result;
+}
+
+EXEC(multu) {
+	uint64_t result = (uint64_t)RS * RT;
+	cpu.hi = result >> 32;
+	cpu.lo = (uint32_t)result;
+}
+
+EXEC(div) {
+	int32_t a = RS, b = RT;
+	/* the result is unpredictable on division by zero, hi/lo are kept */
+	if(b != 0) {
+		if(a == INT32_MIN && b == -1) {
+			cpu.lo = a;
+			cpu.hi = 0;
+		}
+		else {
+			cpu.lo = a / b;
+			cpu.hi = a % b;
+		}
+	}
+}
+
+EXEC(divu) {
+	uint32_t a = RS, b = RT;
+	if(b != 0) {
+		cpu.lo = a / b;
+		cpu.hi = a % b;
+	}
+}
+
+EXEC(madd) { mac(smul(RS, RT), false); }
+EXEC(maddu) { mac((uint64_t)RS * RT, false); }
+EXEC(msub) { mac(smul(RS, RT), true); }
+EXEC(msubu) { mac((uint64_t)RS * RT, true); }
+
+/* branches and jumps */
+
+EXEC(beq) { cond_branch(instr, RS == RT, false); }
+EXEC(bne) { cond_branch(instr, RS != RT, false); }
+EXEC(blez) { cond_branch(instr, (int32_t)RS <= 0, false); }
+EXEC(bgtz) { cond_branch(instr, (int32_t)RS > 0, false); }
+EXEC(beql) { cond_branch(instr, RS == RT, true); }
+EXEC(bnel) { cond_branch(instr, RS != RT, true); }
+EXEC(blezl) { cond_branch(instr, (int32_t)RS <= 0, true); }
+EXEC(bgtzl) { cond_branch(instr, (int32_t)RS > 0, true); }
+EXEC(bltz) { cond_branch(instr, (int32_t)RS < 0, false); }
+EXEC(bgez) { cond_branch(instr, (int32_t)RS >= 0, false); }
+EXEC(bltzl) { cond_branch(instr, (int32_t)RS < 0, true); }
+EXEC(bgezl) { cond_branch(instr, (int32_t)RS >= 0, true); }
+EXEC(bltzal) { link_branch(pc, instr, (int32_t)RS < 0, false); }
+EXEC(bgezal) { link_branch(pc, instr, (int32_t)RS >= 0, false); }
+EXEC(bltzall) { link_branch(pc, instr, (int32_t)RS < 0, true); }
+EXEC(bgezall) { link_branch(pc, instr, (int32_t)RS >= 0, true); }
+
+EXEC(j) { delayed_branch(isa_jump_target(cpu.pc, instr)); }
+
+EXEC(jal) {
+	uint32_t result = cpu.pc + 8;
+	delayed_branch(isa_jump_target(cpu.pc, instr));
+	write_gpr(pc, R_RA, result);
+	notify_observers(call, cpu.pc, cpu.branch_target);
+}
+
+EXEC(jr) {
+	delayed_branch(RS);
+	if(isa_rs(instr) == R_RA) { notify_observers(ret, cpu.pc, cpu.branch_target); }
+}
+
+EXEC(jalr) {
+	uint32_t result = cpu.pc + 8;
+	/* jalr $ra, $ra jumps to the old value */
+	delayed_branch(RS);
+	write_gpr(pc, isa_rd(instr), result);
+	notify_observers(call, cpu.pc, cpu.branch_target);
+}
+
+/* loads and stores */
+
+EXEC(lb) {
+	uint32_t addr = ls_addr(instr);
+	write_gpr(pc, isa_rt(instr), (int32_t)(int8_t)data_read(addr, 1));
+}
+
+EXEC(lbu) {
+	uint32_t addr = ls_addr(instr);
+	write_gpr(pc, isa_rt(instr), data_read(addr, 1));
+}
+
+EXEC(lh) {
+	uint32_t addr = ls_addr(instr);
+	if(!check_align(addr, 2, EXC_ADEL)) { return; }
+	write_gpr(pc, isa_rt(instr), (int32_t)(int16_t)data_read(addr, 2));
+}
+
+EXEC(lhu) {
+	uint32_t addr = ls_addr(instr);
+	if(!check_align(addr, 2, EXC_ADEL)) { return; }
+	write_gpr(pc, isa_rt(instr), data_read(addr, 2));
+}
+
+EXEC(lw) {
+	uint32_t addr = ls_addr(instr);
+	if(!check_align(addr, 4, EXC_ADEL)) { return; }
+	write_gpr(pc, isa_rt(instr), data_read(addr, 4));
+}
+
+/* a single hart: ll is a plain load and sc always succeeds */
+EXEC(ll) { exec_lw(pc, instr); }
+
+EXEC(sb) { data_write(ls_addr(instr), 1, reg_b(isa_rt(instr))); }
+
+EXEC(sh) {
+	uint32_t addr = ls_addr(instr);
+	if(!check_align(addr, 2, EXC_ADES)) { return; }
+	data_write(addr, 2, reg_h(isa_rt(instr)));
+}
+
+EXEC(sw) {
+	uint32_t addr = ls_addr(instr);
+	if(!check_align(addr, 4, EXC_ADES)) { return; }
+	data_write(addr, 4, RT);
+}
+
+EXEC(sc) {
+	uint32_t addr = ls_addr(instr);
+	if(!check_align(addr, 4, EXC_ADES)) { return; }
+	data_write(addr, 4, RT);
+	write_gpr(pc, isa_rt(instr), 1);
+}
+
+/* lwl/lwr/swl/swr for a little-endian guest: `shift' is the byte offset
+ * of the address in its word, counted in bits
+ */
+
+EXEC(lwl) {
+	uint32_t addr = ls_addr(instr), old = RT;
+	int shift = (addr & 0x3) << 3;
+	uint32_t word = data_read(addr & ~0x3, 4);
+	write_gpr(pc, isa_rt(instr), (word << (24 - shift)) | (old & (0x00ffffff >> shift)));
+}
+
+EXEC(lwr) {
+	uint32_t addr = ls_addr(instr), old = RT;
+	int shift = (addr & 0x3) << 3;
+	uint32_t word = data_read(addr & ~0x3, 4);
+	write_gpr(pc, isa_rt(instr), (word >> shift) | (shift ? old & ~(0xffffffff >> shift) : 0));
+}
+
+EXEC(swl) {
+	uint32_t addr = ls_addr(instr);
+	int shift = (addr & 0x3) << 3;
+	uint32_t mask = 0xffffffff >> (24 - shift);
+	uint32_t word = data_read(addr & ~0x3, 4);
+	data_write(addr & ~0x3, 4, (word & ~mask) | ((RT >> (24 - shift)) & mask));
+}
+
+EXEC(swr) {
+	uint32_t addr = ls_addr(instr);
+	int shift = (addr & 0x3) << 3;
+	uint32_t mask = 0xffffffff << shift;
+	uint32_t word = data_read(addr & ~0x3, 4);
+	data_write(addr & ~0x3, 4, (word & ~mask) | ((RT << shift) & mask));
+}
+
+/* cache and pref: there are no caches to manage, and memory accesses
+ * are already in order for sync
+ */
+EXEC(cache) { }
+EXEC(pref) { }
+EXEC(sync) { }
+
+/* traps and exceptions */
+
+EXEC(tge) { trap_if((int32_t)RS >= (int32_t)RT); }
+EXEC(tgeu) { trap_if(RS >= RT); }
+EXEC(tlt) { trap_if((int32_t)RS < (int32_t)RT); }
+EXEC(tltu) { trap_if(RS < RT); }
+EXEC(teq) { trap_if(RS == RT); }
+EXEC(tne) { trap_if(RS != RT); }
+EXEC(tgei) { trap_if((int32_t)RS >= isa_simm(instr)); }
+EXEC(tgeiu) { trap_if(RS >= (uint32_t)isa_simm(instr)); }
+EXEC(tlti) { trap_if((int32_t)RS < isa_simm(instr)); }
+EXEC(tltiu) { trap_if(RS < (uint32_t)isa_simm(instr)); }
+EXEC(teqi) { trap_if((int32_t)RS == isa_simm(instr)); }
+EXEC(tnei) { trap_if((int32_t)RS != isa_simm(instr)); }
+
+EXEC(syscall) { throw_exception(EXC_SYS); }
+EXEC(break) { throw_exception(EXC_BP); }
+
+/* coprocessor 0 */
+
+EXEC(mfc0) { write_gpr(pc, isa_rt(instr), cp0_read(isa_rd(instr))); }
+EXEC(mtc0) { cp0_write(isa_rd(instr), RT); }
+EXEC(eret) { cpu.pc = cp0_eret() - 4; }
+
+/* stop temu, or call the host (see semihost.h) */
+
+EXEC(good_trap) {
+	printf("\33[1;31mtemu: HIT GOOD TRAP\33[0m at $pc = 0x%08x\n\n", cpu.pc);
+	guest_exit_code = 0;
+	temu_state = END;
+}
+
+EXEC(bad_trap) {
+	printf("\33[1;31mtemu: HIT BAD TRAP\33[0m at $pc = 0x%08x\n\n", cpu.pc);
+	guest_exit_code = 1;
+	temu_state = END;
+}
+
+EXEC(semihost) {
+	uint32_t result = semihost_call();
+	if(temu_state != END) { write_gpr(pc, R_V0, result); }
+}
+
+/* superinstructions, see fusion.h */
+
+enum {
+	FUSE_NONE,
+#define FUSION_ENUM(a, b) FUSE_##a##_##b,
+	FUSION_TABLE(FUSION_ENUM)
+#undef FUSION_ENUM
 };
 
-op_fun _2byte_opcode_table [64] = {
-/* 0x00 */	sll, inv, inv, inv, 
-/* 0x04 */	inv, inv, srlv, inv, 
-/* 0x08 */	inv, inv, inv, inv, 
-/* 0x0c */	inv, inv, inv, inv, 
-/* 0x10 */	inv, inv, inv, inv, 
-/* 0x14 */	inv, inv, inv, inv, 
-/* 0x18 */	inv, inv, inv, inv, 
-/* 0x1c */	inv, inv, inv, inv, 
-/* 0x20 */	inv, addu, inv, inv, 
-/* 0x24 */	and, or, xor, inv,
-/* 0x28 */	inv, inv, slt, inv, 
-/* 0x2c */	inv, inv, inv, inv, 
-/* 0x30 */	inv, inv, inv, inv, 
-/* 0x34 */	inv, inv, inv, inv,
-/* 0x38 */	inv, inv, inv, inv, 
-/* 0x3c */	inv, inv, inv, inv
+static const uint8_t fusion_pair[NR_ISA_INSTR][NR_ISA_INSTR] = {
+#define FUSION_PAIR(a, b) [I_##a][I_##b] = FUSE_##a##_##b,
+	FUSION_TABLE(FUSION_PAIR)
+#undef FUSION_PAIR
 };
 
-make_helper(exec) {
-	instr = instr_fetch(pc, 4);
-	ops_decoded.opcode = instr >> 26;
-	opcode_table[ ops_decoded.opcode ](pc);
+#define FUSION_CACHE_SIZE 16384
+
+typedef struct {
+	uint32_t pc;
+	uint32_t first, second;
+	uint8_t kind;
+} FusionEntry;
+
+static FusionEntry fusion_cache[FUSION_CACHE_SIZE];
+uint8_t fusion_pages[FUSION_NR_PAGES];
+bool fusion_enabled = true;
+
+/* the last instruction executed, a pair ends with the current one */
+static uint32_t last_pc = -1, last_instr;
+static int last_id = I_INVALID;
+
+static uint64_t nr_fused = 0, nr_learned = 0;
+static Metric m_fused = { .name = "fusion.pairs_executed", .unit = "pairs", .type = METRIC_COUNTER, .ptr = &nr_fused };
+static Metric m_learned = { .name = "fusion.pairs_cached", .unit = "pairs", .type = METRIC_COUNTER, .ptr = &nr_learned };
+
+static inline FusionEntry *fusion_entry(uint32_t pc) {
+	return &fusion_cache[(pc >> 2) % FUSION_CACHE_SIZE];
+}
+
+void fusion_flush() {
+	memset(fusion_cache, 0, sizeof(fusion_cache));
+	memset(fusion_pages, 0, sizeof(fusion_pages));
+	last_pc = -1;
 }
 
-static make_helper(_2byte_esc) {
-	ops_decoded.func = instr & FUNC_MASK;
-	_2byte_opcode_table[ops_decoded.func](pc); 
+void init_fusion() {
+	metric_register(&m_fused);
+	metric_register(&m_learned);
 }
 
+void fusion_drop_page(uint32_t paddr) {
+	uint32_t page = paddr & ~0xfff, pc;
+	/* the pairs in the page, and the one whose second instruction is
+	 * the first word of the page
+	 */
+	for(pc = page - 4; pc != page + 0x1000; pc += 4) {
+		FusionEntry *e = fusion_entry(pc);
+		if(e->pc == pc) { e->kind = FUSE_NONE; }
+	}
+	fusion_pages[page >> 12] = 0;
+	last_pc = -1;
+}
+
+static inline void fusion_learn(uint32_t pc, int id) {
+	if(pc == last_pc + 4 && fusion_pair[last_id][id] != FUSE_NONE) {
+		FusionEntry *e = fusion_entry(last_pc);
+		e->pc = last_pc;
+		e->first = last_instr;
+		e->second = instr;
+		e->kind = fusion_pair[last_id][id];
+		fusion_pages[last_pc >> 12] = fusion_pages[pc >> 12] = 1;
+		nr_learned ++;
+	}
+	last_pc = pc;
+	last_instr = instr;
+	last_id = id;
+}
+
+/* between the two instructions of a pair, see cpu_exec() */
+static inline void fusion_step() {
+	reg_w(R_ZERO) = 0;
+	cpu.pc += 4;
+	nr_instr ++;
+}
+
+int exec_fused(uint32_t pc, uint32_t *first) {
+	FusionEntry *e = fusion_entry(pc);
+	if(e->pc != pc || e->kind == FUSE_NONE) { return 0; }
+
+	/* the second instruction may be a store that drops the entry */
+	uint32_t a = e->first, b = e->second;
+	bool stopped = false;
+	switch(e->kind) {
+#define FUSION_EXEC(x, y) \
+		case FUSE_##x##_##y: \
+			instr = a; \
+			exec_##x(pc, a); \
+			if(temu_state != RUNNING) { stopped = true; break; } \
+			fusion_step(); \
+			instr = b; \
+			exec_##y(pc + 4, b); \
+			last_id = I_##y; \
+			break;
+		FUSION_TABLE(FUSION_EXEC)
+#undef FUSION_EXEC
+	}
+	reg_w(R_ZERO) = 0;
+
+	if(stopped) {
+		last_pc = pc;
+		last_instr = a;
+		last_id = isa_decode(a);
+		return 1;
+	}
+	last_pc = pc + 4;
+	last_instr = b;
+	nr_fused ++;
+	*first = a;
+	return 2;
+}
+
+make_helper(exec) {
+	instr = instr_fetch(pc, 4);
+	notify_observers(fetch, cpu.pc);
+
+	int id = isa_decode(instr);
+	if(fusion_enabled) { fusion_learn(pc, id); }
+
+	switch(id) {
+#define ISA_EXEC(id, name, index, format) case I_##id: exec_##id(pc, instr); break;
+		ISA_TABLE(ISA_EXEC)
+#undef ISA_EXEC
+		default: inv(pc);
+	}
+
+	/* writes to $zero are discarded */
+	reg_w(R_ZERO) = 0;
+}
@@ -0,0 +1,134 @@
+#include "device/board.h"
+#include "device/mmio.h"
+#include "monitor/monitor.h"
+#include "monitor/reverse.h"
+#include "perf/metrics.h"
+
+#include <inttypes.h>
+
+typedef struct {
+	const char *name;
+	bool writable;		/* by the guest, the others are inputs */
+	uint32_t mask;
+	uint32_t value;
+	Metric changes, last;
+} BoardReg;
+
+#define BOARD_REG(n, w, m) { .name = n, .writable = w, .mask = m, \
+	.changes = { .name = "board." n ".changes", .unit = "changes", .type = METRIC_COUNTER }, \
+	.last = { .name = "board." n ".value", .unit = "value", .type = METRIC_GAUGE } }
+
+static BoardReg regs[NR_BOARD_REG] = {
+	[BOARD_LED] = BOARD_REG("led", true, 0xffffffff),
+	[BOARD_SEG] = BOARD_REG("seg", true, 0xffffffff),
+	[BOARD_SEG_HI] = BOARD_REG("seg_hi", true, 0xf),
+	[BOARD_SW_1] = BOARD_REG("sw_1", false, 0xffffffff),
+	[BOARD_SW_2] = BOARD_REG("sw_2", false, 0xffffffff),
+	[BOARD_BTN] = BOARD_REG("btn", false, 0xff),
+};
+
+uint32_t board_generation = 0;
+
+static FILE *event_fp = NULL;
+
+static void board_update(BoardReg *r, uint32_t value) {
+	value &= r->mask;
+	if(value == r->value) { return; }
+
+	r->value = value;
+	r->last.value = value;
+	r->changes.count ++;
+	board_generation ++;
+	/* logged when it happened the first time */
+	if(event_fp && !replaying) {
+		fprintf(event_fp, "%" PRIu64 " %s %08x\n", nr_instr, r->name, value);
+	}
+}
+
+static uint32_t board_read(void *opaque, uint32_t offset, size_t len) {
+	return regs[offset >> 2].value >> ((offset & 0x3) << 3);
+}
+
+static void board_write(void *opaque, uint32_t offset, size_t len, uint32_t data) {
+	BoardReg *r = &regs[offset >> 2];
+	int shift = (offset & 0x3) << 3;
+	uint32_t mask = (~0u >> ((4 - len) << 3)) << shift;
+
+	if(!r->writable) { return; }
+	board_update(r, (r->value & ~mask) | ((data << shift) & mask));
+}
+
+static void board_sync() {
+	if(event_fp) { fflush(event_fp); }
+}
+
+void board_reset() {
+	int i;
+	for(i = 0; i < NR_BOARD_REG; i ++) {
+		regs[i].value = 0;
+		regs[i].last.value = 0;
+	}
+	board_generation ++;
+}
+
+uint32_t board_get(int reg) {
+	return regs[reg].value;
+}
+
+int board_find(const char *name) {
+	int i;
+	for(i = 0; i < NR_BOARD_REG; i ++) {
+		if(strcmp(name, regs[i].name) == 0) { return i; }
+	}
+	return -1;
+}
+
+bool board_set_input(int reg, uint32_t value) {
+	if(regs[reg].writable) { return false; }
+	guest_touched_host = true;
+	board_update(&regs[reg], value);
+	return true;
+}
+
+bool board_log_open(const char *filename) {
+	board_log_close();
+	event_fp = fopen(filename, "w");
+	return event_fp != NULL;
+}
+
+void board_log_close() {
+	if(event_fp) {
+		fclose(event_fp);
+		event_fp = NULL;
+	}
+}
+
+void board_report(FILE *fp) {
+	int i;
+	for(i = 0; i < NR_BOARD_REG; i ++) {
+		fprintf(fp, "%-7s 0x%08x  %" PRIu64 " changes\n", regs[i].name,
+				regs[i].value, regs[i].changes.count);
+	}
+
+	fprintf(fp, "x7seg   ");
+	for(i = 8; i >= 0; i --) {
+		uint32_t digits = (i == 8) ? regs[BOARD_SEG_HI].value : regs[BOARD_SEG].value >> (i * 4);
+		fprintf(fp, "%x", digits & 0xf);
+	}
+	fprintf(fp, "\nled     ");
+	for(i = 31; i >= 0; i --) {
+		fprintf(fp, "%c", (regs[BOARD_LED].value >> i) & 1 ? '*' : '.');
+	}
+	fprintf(fp, "\n");
+}
+
+void init_board() {
+	int i;
+	mmio_register("board", BOARD_BASE, BOARD_SIZE, board_read, board_write, board_sync, NULL);
+
+	for(i = 0; i < NR_BOARD_REG; i ++) {
+		metric_register(&regs[i].changes);
+		metric_register(&regs[i].last);
+		reverse_register(&regs[i].value, sizeof(regs[i].value));
+	}
+}
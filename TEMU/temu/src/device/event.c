@@ -0,0 +1,96 @@
+#include "device/event.h"
+#include "monitor/monitor.h"
+#include "monitor/reverse.h"
+#include "perf/metrics.h"
+
+/* A binary min-heap ordered by due time, events due at the same time
+ * run in the order they were scheduled.
+ */
+
+#define NR_EVENT 64
+
+typedef struct {
+	uint64_t when, seq;
+	event_handler_t handler;
+	void *arg;
+} Event;
+
+static Event heap[NR_EVENT];
+static int nr_event = 0;
+static uint64_t seq = 0;
+
+uint64_t next_event = UINT64_MAX;
+
+static Metric m_dispatched = { .name = "event.dispatched", .unit = "events", .type = METRIC_COUNTER };
+
+static inline bool before(const Event *a, const Event *b) {
+	return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static void sift_up(int i) {
+	Event e = heap[i];
+	while(i > 0 && before(&e, &heap[(i - 1) / 2])) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = e;
+}
+
+static void sift_down(int i) {
+	Event e = heap[i];
+	for(;;) {
+		int child = 2 * i + 1;
+		if(child >= nr_event) { break; }
+		if(child + 1 < nr_event && before(&heap[child + 1], &heap[child])) { child ++; }
+		if(!before(&heap[child], &e)) { break; }
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = e;
+}
+
+static void remove_at(int i) {
+	heap[i] = heap[-- nr_event];
+	if(i < nr_event) {
+		sift_up(i);
+		sift_down(i);
+	}
+	next_event = nr_event ? heap[0].when : UINT64_MAX;
+}
+
+void event_schedule(uint64_t when, event_handler_t handler, void *arg) {
+	Assert(nr_event < NR_EVENT, "Too many pending events");
+
+	heap[nr_event] = (Event) { .when = when, .seq = seq ++, .handler = handler, .arg = arg };
+	sift_up(nr_event ++);
+	next_event = heap[0].when;
+}
+
+void event_cancel(event_handler_t handler, void *arg) {
+	int i;
+	for(i = nr_event - 1; i >= 0; i --) {
+		if(heap[i].handler == handler && heap[i].arg == arg) { remove_at(i); }
+	}
+}
+
+void event_run() {
+	while(nr_event > 0 && heap[0].when <= nr_instr) {
+		Event e = heap[0];
+		remove_at(0);
+		m_dispatched.count ++;
+		/* the handler may schedule new events */
+		e.handler(e.arg);
+	}
+}
+
+void event_reset() {
+	nr_event = 0;
+	next_event = UINT64_MAX;
+
+	metric_register(&m_dispatched);
+
+	reverse_register(heap, sizeof(heap));
+	reverse_register(&nr_event, sizeof(nr_event));
+	reverse_register(&seq, sizeof(seq));
+	reverse_register(&next_event, sizeof(next_event));
+}
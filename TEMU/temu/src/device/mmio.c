@@ -0,0 +1,86 @@
+#include "device/mmio.h"
+#include "device/uart.h"
+#include "device/board.h"
+
+#define NR_MMIO 16
+
+static MMIORegion regions[NR_MMIO];
+static int nr_region = 0;
+
+uint32_t mmio_low = 0xffffffff;
+
+bool mmio_overlap(uint32_t base, uint32_t size) {
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		if(base < regions[i].base + regions[i].size && regions[i].base < base + size) { return true; }
+	}
+	return false;
+}
+
+void mmio_register(const char *name, uint32_t base, uint32_t size,
+		mmio_read_t read, mmio_write_t write, void (*sync)(), void *opaque) {
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		if(strcmp(regions[i].name, name) == 0) { return; }
+		Assert(base + size <= regions[i].base || base >= regions[i].base + regions[i].size,
+				"MMIO region '%s' overlaps '%s'", name, regions[i].name);
+	}
+	Assert(nr_region < NR_MMIO, "Too many MMIO regions");
+
+	MMIORegion *r = &regions[nr_region ++];
+	r->name = name;
+	r->base = base;
+	r->size = size;
+	r->read = read;
+	r->write = write;
+	r->sync = sync;
+	r->opaque = opaque;
+	if(base < mmio_low) { mmio_low = base; }
+}
+
+void mmio_unregister(const char *name) {
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		if(strcmp(regions[i].name, name) == 0) {
+			regions[i] = regions[-- nr_region];
+			break;
+		}
+	}
+
+	mmio_low = 0xffffffff;
+	for(i = 0; i < nr_region; i ++) {
+		if(regions[i].base < mmio_low) { mmio_low = regions[i].base; }
+	}
+}
+
+MMIORegion *mmio_find(uint32_t paddr) {
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		if(paddr - regions[i].base < regions[i].size) { return &regions[i]; }
+	}
+	return NULL;
+}
+
+void mmio_sync() {
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		if(regions[i].sync) { regions[i].sync(); }
+	}
+}
+
+void mmio_list(FILE *fp) {
+	int i;
+	if(nr_region == 0) {
+		fprintf(fp, "No device.\n");
+		return;
+	}
+	for(i = 0; i < nr_region; i ++) {
+		fprintf(fp, "%-10s 0x%08x - 0x%08x\n", regions[i].name,
+				regions[i].base, regions[i].base + regions[i].size - 1);
+	}
+}
+
+void init_device() {
+	init_uart();
+	init_board();
+}
@@ -0,0 +1,149 @@
+#include "device/semihost.h"
+#include "device/uart.h"
+#include "cpu/reg.h"
+#include "memory/memory.h"
+#include "monitor/monitor.h"
+#include "perf/metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* read and write move the data between the host file and hw_mem in one
+ * system call, they do not go through mem_read()/mem_write() byte by
+ * byte. The buffer must therefore lie in DRAM, and the row buffers of
+ * the DRAM model are invalidated after the guest memory is written.
+ */
+
+#define NR_FILE 32
+
+static int host_fd[NR_FILE];
+static struct timeval start_time;
+static bool initialized = false;
+
+static Metric m_calls = { .name = "semihost.calls", .unit = "calls", .type = METRIC_COUNTER };
+static Metric m_bytes_in = { .name = "semihost.bytes_read", .unit = "bytes", .type = METRIC_COUNTER };
+static Metric m_bytes_out = { .name = "semihost.bytes_written", .unit = "bytes", .type = METRIC_COUNTER };
+
+static uint8_t *guest_buf(uint32_t addr, uint32_t len) {
+	uint32_t paddr = addr & 0x7FFFFFFF;
+	if(paddr >= HW_MEM_SIZE || len > HW_MEM_SIZE - paddr) { return NULL; }
+	return hw_mem + paddr;
+}
+
+static int guest_fd(uint32_t fd) {
+	return fd < NR_FILE ? host_fd[fd] : -1;
+}
+
+static uint32_t sh_open(uint32_t path_addr, uint32_t flags) {
+	char *path = (char *)guest_buf(path_addr, 1);
+	int fd, mode;
+
+	if(path == NULL || memchr(path, '\0', HW_MEM_SIZE - (path_addr & 0x7FFFFFFF)) == NULL) { return -EFAULT; }
+	for(fd = 0; fd < NR_FILE && host_fd[fd] >= 0; fd ++);
+	if(fd == NR_FILE) { return -EMFILE; }
+
+	switch(flags & 0x3) {
+		case SH_O_RDONLY: mode = O_RDONLY; break;
+		case SH_O_WRONLY: mode = O_WRONLY; break;
+		case SH_O_RDWR: mode = O_RDWR; break;
+		default: return -EINVAL;
+	}
+	if(flags & SH_O_CREAT) { mode |= O_CREAT; }
+	if(flags & SH_O_TRUNC) { mode |= O_TRUNC; }
+	if(flags & SH_O_APPEND) { mode |= O_APPEND; }
+
+	host_fd[fd] = open(path, mode, 0644);
+	return host_fd[fd] < 0 ? -errno : fd;
+}
+
+static uint32_t sh_read(uint32_t fd, uint32_t addr, uint32_t len) {
+	uint8_t *buf = guest_buf(addr, len);
+	ssize_t n;
+
+	if(guest_fd(fd) < 0) { return -EBADF; }
+	if(buf == NULL) { return -EFAULT; }
+
+	do { n = read(guest_fd(fd), buf, len); } while(n < 0 && errno == EINTR);
+	if(n < 0) { return -errno; }
+	dram_invalidate(addr & 0x7FFFFFFF, n);
+	m_bytes_in.count += n;
+	return n;
+}
+
+static uint32_t sh_write(uint32_t fd, uint32_t addr, uint32_t len) {
+	uint8_t *buf = guest_buf(addr, len);
+	ssize_t n;
+
+	if(guest_fd(fd) < 0) { return -EBADF; }
+	if(buf == NULL) { return -EFAULT; }
+
+	/* keep the order with the UART and the monitor */
+	if(fd == 1 || fd == 2) {
+		uart_flush();
+		fflush(stdout);
+	}
+
+	do { n = write(guest_fd(fd), buf, len); } while(n < 0 && errno == EINTR);
+	if(n < 0) { return -errno; }
+	m_bytes_out.count += n;
+	return n;
+}
+
+static uint32_t sh_close(uint32_t fd) {
+	if(guest_fd(fd) < 0) { return -EBADF; }
+	if(fd > 2) { close(host_fd[fd]); }
+	host_fd[fd] = -1;
+	return 0;
+}
+
+static uint32_t sh_exit(uint32_t code) {
+	if(code == 0) {
+		printf("\33[1;31mtemu: HIT GOOD TRAP\33[0m at $pc = 0x%08x\n\n", cpu.pc);
+	}
+	else {
+		printf("\33[1;31mtemu: HIT BAD TRAP\33[0m at $pc = 0x%08x, exit code %d\n\n", cpu.pc, code);
+	}
+	temu_state = END;
+	guest_exit_code = code;
+	return code;
+}
+
+static uint32_t sh_clock() {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start_time.tv_sec) * 1000000 + (now.tv_usec - start_time.tv_usec);
+}
+
+uint32_t semihost_call() {
+	uint32_t a0 = cpu.gpr[R_A0]._32, a1 = cpu.gpr[R_A1]._32, a2 = cpu.gpr[R_A2]._32;
+
+	m_calls.count ++;
+	if(cpu.gpr[R_V0]._32 != SH_EXIT) { guest_touched_host = true; }
+	switch(cpu.gpr[R_V0]._32) {
+		case SH_OPEN: return sh_open(a0, a1);
+		case SH_READ: return sh_read(a0, a1, a2);
+		case SH_WRITE: return sh_write(a0, a1, a2);
+		case SH_CLOSE: return sh_close(a0);
+		case SH_EXIT: return sh_exit(a0);
+		case SH_CLOCK: return sh_clock();
+		default: return -ENOSYS;
+	}
+}
+
+void semihost_reset() {
+	int i;
+	for(i = 0; i < NR_FILE; i ++) {
+		if(initialized && i > 2 && host_fd[i] >= 0) { close(host_fd[i]); }
+		host_fd[i] = i <= 2 ? i : -1;
+	}
+	if(!initialized) {
+		gettimeofday(&start_time, NULL);
+		initialized = true;
+	}
+
+	metric_register(&m_calls);
+	metric_register(&m_bytes_in);
+	metric_register(&m_bytes_out);
+}
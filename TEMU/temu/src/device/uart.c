@@ -0,0 +1,142 @@
+#define _GNU_SOURCE
+#include "device/uart.h"
+#include "device/mmio.h"
+#include "monitor/monitor.h"
+#include "monitor/reverse.h"
+#include "perf/metrics.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <termios.h>
+
+/* A byte is sent in no guest time, so the transmitter is always idle.
+ * The output is collected in a buffer and written to the host in large
+ * chunks: when the buffer is full, when the guest waits for input and
+ * when cpu_exec() returns.
+ */
+
+#define TX_BUF_SIZE 4096
+#define RX_BUF_SIZE 256
+
+static char tx_buf[TX_BUF_SIZE];
+static int tx_len = 0;
+
+static uint8_t rx_buf[RX_BUF_SIZE];
+static int rx_head = 0, rx_len = 0;
+
+static int in_fd = -1, out_fd = STDOUT_FILENO;
+static FILE *capture_fp = NULL;
+
+static Metric m_tx = { .name = "uart.tx_bytes", .unit = "bytes", .type = METRIC_COUNTER };
+static Metric m_rx = { .name = "uart.rx_bytes", .unit = "bytes", .type = METRIC_COUNTER };
+static Metric m_host_writes = { .name = "uart.host_writes", .unit = "writes", .type = METRIC_COUNTER };
+
+void uart_flush() {
+	int done = 0;
+	if(tx_len == 0) { return; }
+
+	/* keep the order with what the monitor printed */
+	if(out_fd == STDOUT_FILENO) { fflush(stdout); }
+	if(capture_fp != NULL) { fwrite(tx_buf, 1, tx_len, capture_fp); }
+
+	while(done < tx_len) {
+		ssize_t n = write(out_fd, tx_buf + done, tx_len - done);
+		if(n < 0 && errno == EINTR) { continue; }
+		/* nobody listens on the pty, drop the output */
+		if(n <= 0) { break; }
+		done += n;
+		m_host_writes.count ++;
+	}
+	tx_len = 0;
+}
+
+static bool rx_ready() {
+	if(rx_head < rx_len) { return true; }
+	if(in_fd < 0) { return false; }
+
+	ssize_t n = read(in_fd, rx_buf, RX_BUF_SIZE);
+	if(n <= 0) {
+		/* end of file, or nothing typed into the pty yet */
+		if(n == 0 && in_fd != out_fd) {
+			close(in_fd);
+			in_fd = -1;
+		}
+		return false;
+	}
+	rx_head = 0;
+	rx_len = n;
+	return true;
+}
+
+static uint32_t uart_read(void *opaque, uint32_t offset, size_t len) {
+	switch(offset & ~0x3) {
+		case UART_DATA:
+			if(!rx_ready()) { return 0; }
+			m_rx.count ++;
+			guest_touched_host = true;
+			return rx_buf[rx_head ++];
+		case UART_STATUS:
+			if(rx_ready()) { return UART_TX_IDLE | UART_RX_READY; }
+			/* the guest is polling for input, show it what it printed */
+			uart_flush();
+			return UART_TX_IDLE;
+	}
+	return 0;
+}
+
+static void uart_write(void *opaque, uint32_t offset, size_t len, uint32_t data) {
+	if((offset & ~0x3) != UART_DATA) { return; }
+	/* the byte was sent when it happened the first time */
+	if(replaying) { return; }
+
+	tx_buf[tx_len ++] = data & 0xff;
+	m_tx.count ++;
+	if(tx_len == TX_BUF_SIZE) { uart_flush(); }
+}
+
+bool uart_input_file(const char *filename) {
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) { return false; }
+
+	if(in_fd >= 0 && in_fd != out_fd) { close(in_fd); }
+	in_fd = fd;
+	rx_head = rx_len = 0;
+	return true;
+}
+
+bool uart_open_pty() {
+	struct termios t;
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if(fd < 0) { return false; }
+	if(grantpt(fd) < 0 || unlockpt(fd) < 0 || tcgetattr(fd, &t) < 0) {
+		close(fd);
+		return false;
+	}
+
+	/* pass the bytes through untouched */
+	cfmakeraw(&t);
+	tcsetattr(fd, TCSANOW, &t);
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	uart_flush();
+	if(in_fd >= 0) { close(in_fd); }
+	in_fd = out_fd = fd;
+	rx_head = rx_len = 0;
+	printf("UART is connected to %s\n", ptsname(fd));
+	return true;
+}
+
+void uart_capture(FILE *fp) {
+	uart_flush();
+	capture_fp = fp;
+}
+
+void init_uart() {
+	mmio_register("uart", UART_BASE, UART_SIZE, uart_read, uart_write, uart_flush, NULL);
+
+	metric_register(&m_tx);
+	metric_register(&m_rx);
+	metric_register(&m_host_writes);
+}
@@ -0,0 +1,84 @@
+#include "libtemu.h"
+#include "monitor/monitor.h"
+#include "perf/observer.h"
+#include "cpu/disasm.h"
+
+/* The writeback observer stops cpu_exec() after the instruction that
+ * wrote a register, so TEMU always runs exactly one writeback ahead of
+ * the last one checked.
+ */
+
+#define NR_WB 4
+
+typedef struct {
+	uint32_t pc, wnum, wdata;
+} Writeback;
+
+/* normally an instruction writes at most one register */
+static Writeback wb[NR_WB];
+static int wb_head = 0, nr_wb = 0;
+
+extern uint32_t instr;
+
+static void difftest_writeback(uint32_t pc, int reg, uint32_t value) {
+	if(reg == 0) { return; }
+	Assert(nr_wb < NR_WB, "Too many register writes in one instruction");
+	wb[(wb_head + nr_wb) % NR_WB] = (Writeback) { .pc = pc, .wnum = reg, .wdata = value };
+	nr_wb ++;
+	temu_state = STOP;
+}
+
+static Observer difftest_observer = { .name = "difftest", .writeback = difftest_writeback };
+
+void temu_difftest_init() {
+	static bool initialized = false;
+	if(!initialized) {
+		init_machine();
+		register_observer(&difftest_observer);
+		initialized = true;
+	}
+	restart();
+	wb_head = nr_wb = 0;
+}
+
+int temu_difftest_step(uint32_t *pc, uint32_t *wnum, uint32_t *wdata) {
+	while(nr_wb == 0) {
+		if(temu_state == END) { return 0; }
+		cpu_exec(-1);
+	}
+
+	*pc = wb[wb_head].pc;
+	*wnum = wb[wb_head].wnum;
+	*wdata = wb[wb_head].wdata;
+	wb_head = (wb_head + 1) % NR_WB;
+	nr_wb --;
+	return 1;
+}
+
+int temu_difftest_check(uint32_t pc, uint32_t wnum, uint32_t wdata) {
+	uint32_t ref_pc, ref_wnum, ref_wdata;
+
+	if(!temu_difftest_step(&ref_pc, &ref_wnum, &ref_wdata)) {
+		fprintf(stderr, "difftest: TEMU ended after %llu instructions, but DUT writes $%d = 0x%08x at pc = 0x%08x\n",
+				(unsigned long long)nr_instr, wnum, wdata, pc);
+		return TEMU_DIFFTEST_END;
+	}
+
+	if((pc & 0x1fffffff) != ref_pc || wnum != ref_wnum || wdata != ref_wdata) {
+		char assembly[80];
+		/* the last instruction TEMU executed wrote the reference */
+		disasm(ref_pc, instr, assembly, sizeof(assembly));
+		fprintf(stderr, "difftest: mismatch after %llu instructions (last: %s)\n",
+				(unsigned long long)nr_instr, assembly);
+		fprintf(stderr, "  reference: PC = 0x%08x, wb_rf_wnum = 0x%02x, wb_rf_wdata = 0x%08x\n",
+				ref_pc, ref_wnum, ref_wdata);
+		fprintf(stderr, "  dut:       PC = 0x%08x, wb_rf_wnum = 0x%02x, wb_rf_wdata = 0x%08x\n",
+				pc & 0x1fffffff, wnum, wdata);
+		return TEMU_DIFFTEST_MISMATCH;
+	}
+	return TEMU_DIFFTEST_OK;
+}
+
+uint64_t temu_difftest_instr_count() {
+	return nr_instr;
+}
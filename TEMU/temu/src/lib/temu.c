@@ -0,0 +1,285 @@
+#include "libtemu.h"
+#include "cpu/reg.h"
+#include "cpu/cp0.h"
+#include "cpu/disasm.h"
+#include "memory/memory.h"
+#include "monitor/monitor.h"
+#include "device/mmio.h"
+#include "perf/observer.h"
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The public API of libtemu. The machine is the global state of TEMU,
+ * temu_t only holds the callbacks of the client.
+ */
+
+#define NR_CLIENT_MMIO 8
+
+typedef struct {
+	char name[32];
+	temu_mmio_read_cb read;
+	temu_mmio_write_cb write;
+	void *user;
+} ClientDevice;
+
+struct temu {
+	temu_trace_cb trace;
+	void *trace_user;
+	temu_trap_cb trap;
+	void *trap_user;
+
+	ClientDevice devices[NR_CLIENT_MMIO];
+	int nr_device;
+
+	bool stop_requested;
+};
+
+static temu_t *machine = NULL;
+
+static void lib_writeback(uint32_t pc, int reg, uint32_t value) {
+	if(machine->trace != NULL && machine->trace(machine->trace_user, pc, reg, value)) {
+		machine->stop_requested = true;
+		temu_state = STOP;
+	}
+}
+
+static Observer lib_observer = { .name = "libtemu", .writeback = lib_writeback };
+
+static uint32_t client_read(void *opaque, uint32_t offset, size_t len) {
+	ClientDevice *d = opaque;
+	return d->read != NULL ? d->read(d->user, offset, len) : 0;
+}
+
+static void client_write(void *opaque, uint32_t offset, size_t len, uint32_t data) {
+	ClientDevice *d = opaque;
+	if(d->write != NULL) { d->write(d->user, offset, len, data); }
+}
+
+/* Return the host address of [addr, addr + len) if it is in DRAM. */
+static uint8_t *dram_ptr(uint32_t addr, size_t len) {
+	uint32_t paddr = addr & 0x7FFFFFFF;
+	if(paddr >= HW_MEM_SIZE || len > HW_MEM_SIZE - paddr) { return NULL; }
+	return hw_mem + paddr;
+}
+
+int temu_api_version() {
+	return TEMU_API_VERSION;
+}
+
+temu_t *temu_create() {
+	if(machine != NULL) { return NULL; }
+
+	machine = calloc(1, sizeof(temu_t));
+	if(machine == NULL) { return NULL; }
+
+	init_machine();
+	memset(hw_mem, 0, HW_MEM_SIZE);
+	temu_reset(machine);
+	register_observer(&lib_observer);
+	return machine;
+}
+
+void temu_destroy(temu_t *t) {
+	int i;
+	assert(t == machine);
+	for(i = 0; i < t->nr_device; i ++) {
+		mmio_unregister(t->devices[i].name);
+	}
+	unregister_observer(&lib_observer);
+	free(t);
+	machine = NULL;
+}
+
+void temu_reset(temu_t *t) {
+	memset(cpu.gpr, 0, sizeof(cpu.gpr));
+	cpu.hi = cpu.lo = 0;
+	reset_machine();
+	temu_state = STOP;
+	guest_exit_code = 0;
+}
+
+int temu_load_binary(temu_t *t, const char *path, uint32_t addr) {
+	FILE *fp = fopen(path, "rb");
+	uint8_t *dst;
+	long size;
+	int ret = -1;
+
+	if(fp == NULL) { return -1; }
+	if(fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0) {
+		dst = dram_ptr(addr, size);
+		if(dst != NULL && fread(dst, 1, size, fp) == size) {
+			dram_invalidate(addr & 0x7FFFFFFF, size);
+			ret = 0;
+		}
+	}
+	fclose(fp);
+	return ret;
+}
+
+int temu_load_elf(temu_t *t, const char *path) {
+	FILE *fp = fopen(path, "rb");
+	Elf32_Ehdr eh;
+	Elf32_Phdr ph;
+	uint8_t *dst;
+	int i;
+
+	if(fp == NULL) { return -1; }
+	if(fread(&eh, sizeof(eh), 1, fp) != 1 || memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+			eh.e_ident[EI_CLASS] != ELFCLASS32 || eh.e_ident[EI_DATA] != ELFDATA2LSB ||
+			eh.e_machine != EM_MIPS) {
+		fclose(fp);
+		return -1;
+	}
+
+	for(i = 0; i < eh.e_phnum; i ++) {
+		if(fseek(fp, eh.e_phoff + i * eh.e_phentsize, SEEK_SET) != 0 ||
+				fread(&ph, sizeof(ph), 1, fp) != 1) {
+			goto fail;
+		}
+		if(ph.p_type != PT_LOAD || ph.p_memsz == 0) { continue; }
+
+		dst = dram_ptr(ph.p_vaddr, ph.p_memsz);
+		if(dst == NULL || ph.p_filesz > ph.p_memsz || fseek(fp, ph.p_offset, SEEK_SET) != 0 ||
+				fread(dst, 1, ph.p_filesz, fp) != ph.p_filesz) {
+			goto fail;
+		}
+		/* .bss */
+		memset(dst + ph.p_filesz, 0, ph.p_memsz - ph.p_filesz);
+		dram_invalidate(ph.p_vaddr & 0x7FFFFFFF, ph.p_memsz);
+	}
+
+	fclose(fp);
+	cpu.pc = eh.e_entry;
+	cpu.delay_slot = false;
+	return 0;
+
+fail:
+	fclose(fp);
+	return -1;
+}
+
+int temu_run(temu_t *t, uint64_t n, uint64_t *executed) {
+	uint64_t start = nr_instr;
+	int reason = TEMU_STOP_COUNT;
+
+	t->stop_requested = false;
+	while(temu_state != END && nr_instr - start < n) {
+		uint64_t left = n - (nr_instr - start);
+		cpu_exec(left > 0x7fffffff ? 0x7fffffff : left);
+
+		if(temu_state == END) {
+			if(t->trap != NULL) { t->trap(t->trap_user, guest_exit_code); }
+			break;
+		}
+		if(t->stop_requested) {
+			reason = TEMU_STOP_CALLBACK;
+			break;
+		}
+	}
+
+	if(temu_state == END) { reason = TEMU_STOP_END; }
+	if(executed != NULL) { *executed = nr_instr - start; }
+	return reason;
+}
+
+int temu_exit_code(temu_t *t) {
+	return temu_state == END ? guest_exit_code : -1;
+}
+
+uint64_t temu_instr_count(temu_t *t) {
+	return nr_instr;
+}
+
+void temu_read_regs(temu_t *t, uint32_t regs[TEMU_NR_REGS]) {
+	int i;
+	for(i = 0; i < 32; i ++) { regs[i] = cpu.gpr[i]._32; }
+	regs[TEMU_REG_HI] = cpu.hi;
+	regs[TEMU_REG_LO] = cpu.lo;
+	regs[TEMU_REG_PC] = cpu.pc;
+}
+
+void temu_write_regs(temu_t *t, const uint32_t regs[TEMU_NR_REGS]) {
+	int i;
+	for(i = 1; i < 32; i ++) { cpu.gpr[i]._32 = regs[i]; }
+	cpu.hi = regs[TEMU_REG_HI];
+	cpu.lo = regs[TEMU_REG_LO];
+	if(cpu.pc != regs[TEMU_REG_PC]) {
+		cpu.pc = regs[TEMU_REG_PC];
+		cpu.delay_slot = false;
+	}
+}
+
+uint32_t temu_read_cp0(temu_t *t, int reg) {
+	return reg >= 0 && reg < 32 ? cp0_read(reg) : 0;
+}
+
+void temu_write_cp0(temu_t *t, int reg, uint32_t value) {
+	if(reg >= 0 && reg < 32) { cp0_write(reg, value); }
+}
+
+int temu_read_mem(temu_t *t, uint32_t addr, void *buf, size_t len) {
+	uint8_t *src = dram_ptr(addr, len);
+	size_t i;
+
+	if(src != NULL) {
+		memcpy(buf, src, len);
+		return 0;
+	}
+	for(i = 0; i < len; i ++) {
+		if(((addr + i) & 0x7FFFFFFF) < mmio_low || mmio_find((addr + i) & 0x7FFFFFFF) == NULL) { return -1; }
+		((uint8_t *)buf)[i] = mem_read(addr + i, 1);
+	}
+	return 0;
+}
+
+int temu_write_mem(temu_t *t, uint32_t addr, const void *buf, size_t len) {
+	uint8_t *dst = dram_ptr(addr, len);
+	size_t i;
+
+	if(dst != NULL) {
+		memcpy(dst, buf, len);
+		dram_invalidate(addr & 0x7FFFFFFF, len);
+		return 0;
+	}
+	for(i = 0; i < len; i ++) {
+		if(((addr + i) & 0x7FFFFFFF) < mmio_low || mmio_find((addr + i) & 0x7FFFFFFF) == NULL) { return -1; }
+		mem_write(addr + i, 1, ((const uint8_t *)buf)[i]);
+	}
+	return 0;
+}
+
+void temu_disasm(uint32_t pc, uint32_t instr, char *buf, size_t size) {
+	disasm(pc, instr, buf, size);
+}
+
+void temu_on_trace(temu_t *t, temu_trace_cb cb, void *user) {
+	t->trace = cb;
+	t->trace_user = user;
+}
+
+void temu_on_trap(temu_t *t, temu_trap_cb cb, void *user) {
+	t->trap = cb;
+	t->trap_user = user;
+}
+
+int temu_map_mmio(temu_t *t, const char *name, uint32_t addr, uint32_t size,
+		temu_mmio_read_cb read, temu_mmio_write_cb write, void *user) {
+	uint32_t paddr = addr & 0x7FFFFFFF;
+	ClientDevice *d;
+
+	/* devices live above the DRAM, see mmio.h */
+	if(t->nr_device == NR_CLIENT_MMIO || size == 0 || paddr < HW_MEM_SIZE ||
+			paddr + size < paddr || mmio_overlap(paddr, size)) {
+		return -1;
+	}
+
+	d = &t->devices[t->nr_device ++];
+	snprintf(d->name, sizeof(d->name), "%s", name);
+	d->read = read;
+	d->write = write;
+	d->user = user;
+	mmio_register(d->name, paddr, size, client_read, client_write, NULL, d);
+	return 0;
+}
@@ -1,31 +1,222 @@
 #include "monitor/gui.h"
+#include "perf/zone.h"
+#include "perf/metrics.h"
+#include "device/uart.h"
+#include "device/board.h"
+#include "monitor/trace.h"
+#include "monitor/tracecache.h"
+#include "cpu/fusion.h"
+#include "perf/profile.h"
+#include "perf/simpoint.h"
+#include "monitor/mode.h"
+#include "monitor/monitor.h"
+#include "monitor/forkserver.h"
+
+#include <stdlib.h>
 
 void init_monitor(int, char *[]);
 void restart();
 void ui_mainloop();
 
+/* The whole file, NULL if it can not be read. */
+static char *read_file(const char *filename) {
+    FILE *fp = fopen(filename, "r");
+    if(fp == NULL) { return NULL; }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = malloc(size + 1);
+    if(buf != NULL) {
+        buf[fread(buf, 1, size, fp)] = '\0';
+    }
+    fclose(fp);
+    return buf;
+}
+
+/* Remove the `n' arguments starting from argv[i]. */
+static void remove_args(int *argc, char *argv[], int i, int n) {
+    /* argv[argc] is NULL as well */
+    for(int j = i; j + n <= *argc; j++) {
+        argv[j] = argv[j + n];
+    }
+    *argc -= n;
+}
+
 int main(int argc, char *argv[]) {
     /* 如果有-gui参数，启动图形界面 */
     int use_gui = 0;
-    for(int i = 1; i < argc; i++) {
+    const char *metrics_file = NULL;
+    const char *profile_file = NULL, *profile_elf = NULL;
+    const char *bbv_file = NULL, *simpoints = NULL;
+    uint64_t interval = SIMPOINT_INTERVAL;
+    bool start_fast = false;
+    const char *detail_pc = NULL, *detail_instr = NULL;
+    char *script = NULL;
+    const char *server = NULL;
+    const char *cache = NULL;
+    unsigned timeout = 0;
+    for(int i = 1; i < argc; ) {
         if(strcmp(argv[i], "-gui") == 0) {
             use_gui = 1;
             // 移除这个参数
-            for(int j = i; j < argc - 1; j++) {
-                argv[j] = argv[j + 1];
+            remove_args(&argc, argv, i, 1);
+        } else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            /* run the monitor commands in the file, without readline */
+            script = read_file(argv[i + 1]);
+            if(script == NULL) {
+                printf("Cannot read %s\n", argv[i + 1]);
+                return EXIT_NOT_ENDED;
+            }
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            /* run the commands, e.g. "c; info r; q" */
+            script = strdup(argv[i + 1]);
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--fork-server") == 0 && i + 1 < argc) {
+            /* fork a child per request on the socket, or on stdin for "-" */
+            server = argv[i + 1];
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            /* stop the guest after so many seconds */
+            timeout = strtoul(argv[i + 1], NULL, 0);
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--trace-events") == 0 && i + 1 < argc) {
+            /* Chrome trace-event JSON of the emulator phases */
+            if(!zone_open(argv[i + 1])) {
+                printf("Warning: Cannot open %s for writing\n", argv[i + 1]);
             }
-            argc--;
-            break;
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--trace-binary") == 0) {
+            /* golden_trace.bin instead of golden_trace.txt */
+            trace_binary = true;
+            remove_args(&argc, argv, i, 1);
+        } else if(strcmp(argv[i], "--metrics-out") == 0 && i + 1 < argc) {
+            /* JSON dump of the run metrics at exit */
+            metrics_file = argv[i + 1];
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--uart-in") == 0 && i + 1 < argc) {
+            /* the guest reads the UART input from a file */
+            if(!uart_input_file(argv[i + 1])) {
+                printf("Warning: Cannot open %s\n", argv[i + 1]);
+            }
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--uart-pty") == 0) {
+            /* connect the UART to a new pseudo terminal */
+            if(!uart_open_pty()) {
+                printf("Warning: Cannot open a pty for the UART\n");
+            }
+            remove_args(&argc, argv, i, 1);
+        } else if(strcmp(argv[i], "--board-log") == 0 && i + 1 < argc) {
+            /* log the changes of LEDs, x7seg, switches and buttons */
+            if(!board_log_open(argv[i + 1])) {
+                printf("Warning: Cannot open %s for writing\n", argv[i + 1]);
+            }
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--no-fusion") == 0) {
+            /* run every instruction on its own, see cpu/fusion.h */
+            fusion_enabled = false;
+            remove_args(&argc, argv, i, 1);
+        } else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            /* callgrind call graph of the guest functions at exit */
+            profile_file = argv[i + 1];
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--profile-elf") == 0 && i + 1 < argc) {
+            /* the ELF file whose symbols name the functions */
+            profile_elf = argv[i + 1];
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--bbv") == 0 && i + 1 < argc) {
+            /* basic-block vectors for tools/simpoint.c */
+            bbv_file = argv[i + 1];
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--simpoints") == 0 && i + 1 < argc) {
+            /* run only the simulation points in detail */
+            simpoints = argv[i + 1];
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--sample-interval") == 0 && i + 1 < argc) {
+            /* instructions per interval of --bbv and --simpoints */
+            interval = strtoull(argv[i + 1], NULL, 0);
+            if(interval == 0) { interval = SIMPOINT_INTERVAL; }
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--fast-forward") == 0) {
+            /* start without the DDR3 model, trace, log and observers */
+            start_fast = true;
+            remove_args(&argc, argv, i, 1);
+        } else if(strcmp(argv[i], "--detail-at-pc") == 0 && i + 1 < argc) {
+            /* back to the detailed mode when $pc reaches the address */
+            detail_pc = argv[i + 1];
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--detail-at") == 0 && i + 1 < argc) {
+            /* back to the detailed mode after N instructions */
+            detail_instr = argv[i + 1];
+            remove_args(&argc, argv, i, 2);
+        } else if(strcmp(argv[i], "--trace-cache") == 0 && i + 1 < argc) {
+            /* reuse the results of earlier runs of the same image */
+            cache = argv[i + 1];
+            remove_args(&argc, argv, i, 2);
+        } else {
+            i++;
         }
     }
     
+    /* 服务器的每个请求都要真正运行，父进程不能先从缓存结束程序 */
+    if(cache != NULL && server != NULL) {
+        printf("--trace-cache can not be used with --fork-server\n");
+        return EXIT_NOT_ENDED;
+    }
+    /* 缓存的结果只有完整的详细运行：分析和模式选项需要真正执行 */
+    if(cache != NULL && (profile_file != NULL || bbv_file != NULL || simpoints != NULL ||
+                start_fast || detail_pc != NULL || detail_instr != NULL)) {
+        printf("Warning: The trace cache is not used with --profile, --bbv, --simpoints, "
+                "--fast-forward or --detail-at\n");
+        cache = NULL;
+    }
+    if(cache != NULL && !trace_cache_open(cache)) {
+        printf("Warning: Cannot use %s as the trace cache\n", cache);
+    }
+
     /* Initialize the monitor. */
     init_monitor(argc, argv);
     
     /* Initialize the virtual computer system. */
     restart();
+    trace_cache_load();
+
+    if(profile_file != NULL && !profile_enable(profile_elf)) {
+        printf("Warning: Cannot read the symbols of %s\n", profile_elf);
+        profile_enable(NULL);
+    }
+    if(start_fast) {
+        mode_set(true);
+    }
+    if(detail_pc != NULL) {
+        mode_at_pc(strtoul(detail_pc, NULL, 0), false);
+    }
+    if(detail_instr != NULL) {
+        mode_at_instr(strtoull(detail_instr, NULL, 0), false);
+    }
+    if(bbv_file != NULL && !bbv_enable(bbv_file, interval)) {
+        printf("Warning: Cannot open %s for writing\n", bbv_file);
+    }
+    if(simpoints != NULL && !sample_enable(simpoints, interval)) {
+        printf("Warning: Cannot read the simulation points %s.simpoints and %s.weights\n", simpoints, simpoints);
+        simpoints = NULL;
+    }
     
-    if(use_gui) {
+    /* every run of the fork server has its own timeout */
+    if(timeout > 0 && server == NULL) {
+        ui_set_timeout(timeout);
+    }
+
+    if(server != NULL) {
+        /* 服务器模式：每个请求在fork出的子进程中运行 */
+        if(!fork_server(server, timeout)) {
+            printf("Cannot listen on %s\n", server);
+            return EXIT_NOT_ENDED;
+        }
+    } else if(script != NULL) {
+        /* 批处理模式 */
+        ui_run_script(script);
+    } else if(use_gui) {
         /* 图形界面模式 */
 #ifdef USE_GUI
         init_gui(&argc, &argv);
@@ -40,5 +231,24 @@ int main(int argc, char *argv[]) {
         ui_mainloop();
     }
     
+    trace_cache_store();
+    bbv_disable();
+    if(simpoints != NULL) {
+        sample_report(stdout);
+    }
+    if(profile_file != NULL && !profile_write_callgrind(profile_file)) {
+        printf("Warning: Cannot write the profile to %s\n", profile_file);
+    }
+    zone_close();
+    board_log_close();
+    if(metrics_file != NULL && !metrics_write(metrics_file)) {
+        printf("Warning: Cannot write metrics to %s\n", metrics_file);
+    }
+
+    /* 批处理模式的退出码：good trap为0，bad trap为1 */
+    if(server == NULL && (script != NULL || timeout > 0)) {
+        free(script);
+        return ui_exit_code();
+    }
     return 0;
 }
@@ -1,6 +1,9 @@
 #include "common.h"
 #include "burst.h"
 #include "misc.h"
+#include "perf/metrics.h"
+#include "cpu/fusion.h"
+#include "monitor/reverse.h"
 
 /* Simulate the (main) behavor of DRAM.
  * Although this will lower the performace of TEMU, it makes
@@ -42,7 +45,18 @@ typedef struct {
 
 RB rowbufs[NR_RANK][NR_BANK];
 
-void init_ddr3() {
+/* Off during the fast-forward of a sampled run: the accesses go to the
+ * array directly, without the row buffers.
+ */
+bool dram_model = true;
+
+static Metric m_dram_reads = { .name = "dram.burst_reads", .unit = "bursts", .type = METRIC_COUNTER };
+static Metric m_dram_writes = { .name = "dram.burst_writes", .unit = "bursts", .type = METRIC_COUNTER };
+static Metric m_dram_row_hits = { .name = "dram.row_buffer_hits", .unit = "accesses", .type = METRIC_COUNTER };
+static Metric m_dram_row_misses = { .name = "dram.row_buffer_misses", .unit = "accesses", .type = METRIC_COUNTER };
+static Metric m_dram_accesses = { .name = "dram.accesses", .unit = "accesses", .type = METRIC_COUNTER };
+
+static void invalidate_rowbufs() {
 	int i, j;
 	for(i = 0; i < NR_RANK; i ++) {
 		for(j = 0; j < NR_BANK; j ++) {
@@ -51,6 +65,22 @@ void init_ddr3() {
 	}
 }
 
+void init_ddr3() {
+	invalidate_rowbufs();
+
+	metric_register(&m_dram_reads);
+	metric_register(&m_dram_writes);
+	metric_register(&m_dram_row_hits);
+	metric_register(&m_dram_row_misses);
+	metric_register(&m_dram_accesses);
+}
+
+void dram_set_model(bool on) {
+	/* the array was written behind the row buffers */
+	if(on && !dram_model) { invalidate_rowbufs(); }
+	dram_model = on;
+}
+
 static void ddr3_read(uint32_t addr, void *data) {
 
 	Assert(addr < HW_MEM_SIZE, "physical address %x is outside of the physical memory!", addr);
@@ -67,9 +97,14 @@ static void ddr3_read(uint32_t addr, void *data) {
 		memcpy(rowbufs[rank][bank].buf, dram[rank][bank][row], NR_COL);
 		rowbufs[rank][bank].row_idx = row;
 		rowbufs[rank][bank].valid = true;
+		m_dram_row_misses.count ++;
+	}
+	else {
+		m_dram_row_hits.count ++;
 	}
 
 	/* burst read */
+	m_dram_reads.count ++;
 	memcpy(data, rowbufs[rank][bank].buf + col, BURST_LEN);
 }
 
@@ -88,9 +123,14 @@ static void ddr3_write(uint32_t addr, void *data, uint8_t *mask) {
 		memcpy(rowbufs[rank][bank].buf, dram[rank][bank][row], NR_COL);
 		rowbufs[rank][bank].row_idx = row;
 		rowbufs[rank][bank].valid = true;
+		m_dram_row_misses.count ++;
+	}
+	else {
+		m_dram_row_hits.count ++;
 	}
 
 	/* burst write */
+	m_dram_writes.count ++;
 	memcpy_with_mask(rowbufs[rank][bank].buf + col, data, BURST_LEN, mask);
 
 	/* write back to dram */
@@ -100,7 +140,15 @@ static void ddr3_write(uint32_t addr, void *data, uint8_t *mask) {
 uint32_t dram_read(uint32_t addr, size_t len) {
 	uint32_t offset = addr & BURST_MASK;
 	uint8_t temp[2 * BURST_LEN];
-	
+
+	m_dram_accesses.count ++;
+	if(!dram_model) {
+		Assert(addr + len <= HW_MEM_SIZE, "physical address %x is outside of the physical memory!", addr);
+		uint32_t data = 0;
+		memcpy(&data, hw_mem + addr, len);
+		return data;
+	}
+
 	ddr3_read(addr, temp);
 
 	if(offset + len > BURST_LEN) {
@@ -115,8 +163,17 @@ void dram_write(uint32_t addr, size_t len, uint32_t data) {
 	uint32_t offset = addr & BURST_MASK;
 	uint8_t temp[2 * BURST_LEN];
 	uint8_t mask[2 * BURST_LEN];
-	memset(mask, 0, 2 * BURST_LEN);
 
+	m_dram_accesses.count ++;
+	reverse_write(addr, len);
+	fusion_invalidate(addr, len);
+	if(!dram_model) {
+		Assert(addr + len <= HW_MEM_SIZE, "physical address %x is outside of the physical memory!", addr);
+		memcpy(hw_mem + addr, &data, len);
+		return;
+	}
+
+	memset(mask, 0, 2 * BURST_LEN);
 	*(uint32_t *)(temp + offset) = data;
 	memset(mask + offset, 1, len);
 
@@ -127,3 +184,16 @@ void dram_write(uint32_t addr, size_t len, uint32_t data) {
 		ddr3_write(addr + BURST_LEN, temp + BURST_LEN, mask + BURST_LEN);
 	}
 }
+
+void dram_invalidate(uint32_t addr, size_t len) {
+	uint32_t a;
+	dram_addr temp;
+
+	fusion_invalidate(addr, len);
+	for(a = addr & ~(NR_COL - 1); a < addr + len; a += NR_COL) {
+		temp.addr = a;
+		if(rowbufs[temp.rank][temp.bank].row_idx == temp.row) {
+			rowbufs[temp.rank][temp.bank].valid = false;
+		}
+	}
+}
@@ -1,4 +1,5 @@
 #include "common.h"
+#include "device/mmio.h"
 
 typedef uint32_t hwaddr_t;
 
@@ -12,6 +13,10 @@ uint32_t mem_read(uint32_t addr, size_t len) {
 	assert(len == 1 || len == 2 || len == 4);
 #endif
         hwaddr_t paddr = addr & 0x7FFFFFFF;
+	if(paddr >= mmio_low) {
+		MMIORegion *r = mmio_find(paddr);
+		if(r != NULL) { return r->read(r->opaque, paddr - r->base, len) & (~0u >> ((4 - len) << 3)); }
+	}
 	return dram_read(paddr, len) & (~0u >> ((4 - len) << 3));
 }
 
@@ -20,6 +25,13 @@ void mem_write(uint32_t addr, size_t len, uint32_t data) {
 	assert(len == 1 || len == 2 || len == 4);
 #endif
         hwaddr_t paddr = addr & 0x7FFFFFFF;
+	if(paddr >= mmio_low) {
+		MMIORegion *r = mmio_find(paddr);
+		if(r != NULL) {
+			r->write(r->opaque, paddr - r->base, len, data);
+			return;
+		}
+	}
 	dram_write(paddr, len, data);
 }
 
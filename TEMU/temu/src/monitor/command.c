@@ -3,6 +3,7 @@
 #include "memory.h"
 #include "monitor.h"
 #include "expr.h"
+#include "reverse.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -41,11 +42,23 @@ int handle_command(const char *cmd_line) {
         printf("  help           - Show this help\n");
         printf("  c              - Continue execution\n");
         printf("  si [N]         - Step N instructions (default: 1)\n");
+        printf("  rsi [N]        - Step back N instructions (default: 1)\n");
+        printf("  rc             - Continue backwards to a watchpoint change\n");
         printf("  info r         - Show register values\n");
         printf("  x N EXPR       - Examine memory\n");
         printf("  w EXPR         - Set watchpoint\n");
         printf("  d N            - Delete watchpoint\n");
         printf("  q              - Quit\n");
+    } else if(strncmp(cmd, "rsi", 3) == 0) {
+        // 反向单步：回到最近的检查点再重新执行
+        uint64_t n = 1;
+        if(strlen(cmd) > 3) {
+            n = strtoull(cmd + 3, NULL, 0);
+            if(n == 0) n = 1;
+        }
+        reverse_step(n);
+    } else if(strcmp(cmd, "rc") == 0) {
+        reverse_continue();
     } else if(strncmp(cmd, "si", 2) == 0) {
         int n = 1;
         if(strlen(cmd) > 2) {
@@ -1,6 +1,18 @@
 #include "monitor.h"
 #include "helper.h"
+#include "disasm.h"
+#include "fusion.h"
 #include "monitor/watchpoint.h"
+#include "perf/observer.h"
+#include "perf/zone.h"
+#include "perf/metrics.h"
+#include "device/mmio.h"
+#include "device/event.h"
+#include "monitor/trace.h"
+#include "monitor/reverse.h"
+#include "monitor/mode.h"
+
+#include <time.h>
 
 /* The assembly code of instructions executed is only output to the screen
  * when the number of instructions executed is less than this value.
@@ -10,42 +22,116 @@
 #define MAX_INSTR_TO_PRINT 10
 
 int temu_state = STOP;
+int guest_exit_code = 0;
+volatile sig_atomic_t timed_out = 0;
+bool guest_touched_host = false;
+
+uint64_t nr_instr = 0;
+
+static uint64_t run_time_ns = 0;
+
+static double run_seconds() { return run_time_ns / 1e9; }
+static double guest_mips() { return run_time_ns ? nr_instr * 1e3 / run_time_ns : 0.0; }
+static double cpu_pc() { return cpu.pc; }
+static double cpu_ended() { return temu_state == END; }
+
+static Metric m_instr = { .name = "cpu.instructions", .unit = "instructions", .type = METRIC_COUNTER, .ptr = &nr_instr };
+static Metric m_run_time = { .name = "run.wall_seconds", .unit = "s", .type = METRIC_GAUGE, .read = run_seconds };
+static Metric m_mips = { .name = "run.guest_mips", .unit = "MIPS", .type = METRIC_GAUGE, .read = guest_mips };
+static Metric m_batch = { .name = "run.batch_instructions", .unit = "instructions", .type = METRIC_HISTOGRAM };
+static Metric m_pc = { .name = "cpu.pc", .unit = "address", .type = METRIC_GAUGE, .read = cpu_pc };
+static Metric m_ended = { .name = "cpu.ended", .unit = "bool", .type = METRIC_GAUGE, .read = cpu_ended };
+
+void init_cpu_metrics() {
+	metric_register(&m_instr);
+	metric_register(&m_run_time);
+	metric_register(&m_mips);
+	metric_register(&m_batch);
+	metric_register(&m_pc);
+	metric_register(&m_ended);
+}
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
 void exec(uint32_t);
 
-char assembly[80];
+extern uint32_t instr;
+
 char asm_buf[128];
 
+/* The bytes are read from hw_mem, not through the DDR3 model, which
+ * would count them as accesses of the guest.
+ */
 void print_bin_instr(uint32_t pc) {
 	int i;
 	int l = sprintf(asm_buf, "%8x:   ", pc);
 	for(i = 3; i >= 0; i --) {
-		l += sprintf(asm_buf + l, "%02x ", instr_fetch(pc + i, 1));
+		l += sprintf(asm_buf + l, "%02x ", pc + i < HW_MEM_SIZE ? hw_mem[pc + i] : 0);
 	}
 	sprintf(asm_buf + l, "%*.s", 8, "");
 }
 
+#ifdef DEBUG
+static void log_instr(uint32_t pc, uint32_t vpc, uint32_t instr, bool print) {
+	ZONE("log");
+	print_bin_instr(pc);
+	/* disassembled here, only when the log is written */
+	size_t len = strlen(asm_buf);
+	disasm(vpc, instr, asm_buf + len, sizeof(asm_buf) - len);
+	Log_write("%s\n", asm_buf);
+	if(print) {
+		printf("%s\n", asm_buf);
+	}
+}
+#endif
+
+/* Superinstructions are only run when nothing looks at the single
+ * instructions, see fusion.h. The watchpoints are not checked in the
+ * fast-forward mode.
+ */
+static inline bool can_fuse() {
+	return fusion_enabled && !observers_see_instr() && (fast_forward || !wp_active());
+}
+
 /* Simulate how the MiniMIPS32 CPU works. */
 void cpu_exec(volatile uint32_t n) {
-	
-	uint32_t pc;
+	ZONE("cpu_exec");
+
+	uint32_t pc, vpc;
 	if(temu_state == END) {
 		printf("Program execution has ended. To restart the program, exit TEMU and run again.\n");
 		return;
 	}
 	temu_state = RUNNING;
 
+	uint64_t start_ns = now_ns();
+	uint64_t start_instr = nr_instr;
+
 #ifdef DEBUG
-	volatile uint32_t n_temp = n;
+	/* not when the history is run again, see reverse.h */
+	bool print = n < MAX_INSTR_TO_PRINT && !replaying;
 #endif
 
+	bool fuse = can_fuse();
+
 	for(; n > 0; n --) {
+		if(timed_out) { break; }
+
+		if(cpu.pc == mode_pc) {
+			mode_pc_reached();
+			fuse = can_fuse();
+		}
 
+		vpc = cpu.pc;
 		pc = cpu.pc & 0x1fffffff;  //map the virtual address to the physical address, e.g. high 3 bits in cpu.pc are cleared
 		
 #ifdef DEBUG
 		uint32_t pc_temp = pc;
-		if((n & 0xffff) == 0) {
+		if((n & 0xffff) == 0 && log_fp != NULL && !fast_forward) {
 			
 			fputc('.', stderr);
 		}
@@ -53,26 +139,62 @@ void cpu_exec(volatile uint32_t n) {
 
 		/* Execute one instruction, including instruction fetch,
 		 * instruction decode, and the actual execution. */
-		exec(pc);
+		bool in_delay_slot = cpu.delay_slot;
+		uint32_t first;
+		int fused = 0;
+		if(fuse && n > 1 && !in_delay_slot && nr_instr + 1 < next_event && vpc + 4 != mode_pc) {
+			fused = exec_fused(pc, &first);
+		}
+		if(fused == 2) {
+			/* a fused pair, the first instruction is retired */
+			n --;
+#ifdef DEBUG
+			if(log_fp != NULL && !fast_forward) { log_instr(pc, vpc, first, print); }
+			pc_temp += 4;
+#endif
+			vpc += 4;
+		}
+		else if(fused == 0) {
+			exec(pc);
+		}
 
-		cpu.pc += 4;
+		if(in_delay_slot && cpu.delay_slot) {
+			/* the delay slot is done, go to the branch target */
+			cpu.delay_slot = false;
+			cpu.pc = cpu.branch_target;
+		}
+		else {
+			cpu.pc += 4;
+		}
+		nr_instr ++;
+
+		notify_observers(retire, vpc, instr, cpu.pc);
 
 #ifdef DEBUG
-		print_bin_instr(pc_temp);
-		strcat(asm_buf, assembly);
-		Log_write("%s\n", asm_buf);
-		if(n_temp < MAX_INSTR_TO_PRINT) {
-			printf("%s\n", asm_buf);
-		}
+		/* before the events, a checkpoint (see reverse.h) includes the line */
+		if(log_fp != NULL && !fast_forward) { log_instr(pc_temp, vpc, instr, print); }
 #endif
 
+		/* timers, interrupts and other device events */
+		if(nr_instr >= next_event) {
+			event_run();
+			/* an event may switch the mode, see mode.h */
+			fuse = can_fuse();
+		}
+
 		/* TODO: check watchpoints here. */
-		if(check_wp()) {
+		if(!fast_forward && check_wp()) {
     			temu_state = STOP;
-    			return;
+    			break;
 		}
-		if(temu_state != RUNNING) { return; }
+		if(temu_state != RUNNING) { break; }
 	}
 
 	if(temu_state == RUNNING) { temu_state = STOP; }
+
+	mmio_sync();
+	flush_trace();
+
+	run_time_ns += now_ns() - start_ns;
+	metric_observe(&m_batch, nr_instr - start_instr);
 }
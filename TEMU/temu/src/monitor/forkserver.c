@@ -0,0 +1,155 @@
+#include "monitor/forkserver.h"
+#include "monitor/monitor.h"
+#include "perf/metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+static volatile sig_atomic_t stopping = 0;
+
+/* the outputs of the image before the first instruction */
+static long trace_base, log_base;
+
+static Metric m_requests = { .name = "server.requests", .unit = "requests", .type = METRIC_COUNTER };
+static Metric m_good = { .name = "server.good_traps", .unit = "requests", .type = METRIC_COUNTER };
+static Metric m_bad = { .name = "server.bad_traps", .unit = "requests", .type = METRIC_COUNTER };
+static Metric m_timeouts = { .name = "server.timeouts", .unit = "requests", .type = METRIC_COUNTER };
+static Metric m_crashes = { .name = "server.crashes", .unit = "requests", .type = METRIC_COUNTER };
+static Metric m_latency = { .name = "server.request_us", .unit = "us", .type = METRIC_HISTOGRAM };
+
+static void stop_handler(int sig) {
+	stopping = 1;
+}
+
+static uint64_t now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void run_child(char *commands, int out, unsigned timeout) {
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	dup2(out, STDOUT_FILENO);
+	dup2(out, STDERR_FILENO);
+
+	/* the files are shared with the server, the latest run overwrites them */
+	output_rewind(trace_base, log_base);
+
+	if(timeout > 0) { ui_set_timeout(timeout); }
+	ui_run_script(commands);
+
+	/* not exit(), which would move the offset of the input shared with
+	 * the server back to what the copy of its FILE in the child has read
+	 */
+	fflush(NULL);
+	_exit(ui_exit_code());
+}
+
+/* Run the requests read from `in', answer on `out'. */
+static void serve(int in, int out, unsigned timeout) {
+	FILE *fp = fdopen(dup(in), "r");
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+
+	if(fp == NULL) { return; }
+
+	while(!stopping && (len = getline(&line, &cap, fp)) > 0) {
+		uint64_t start = now_us();
+		int status, code;
+		pid_t pid;
+
+		if(line[len - 1] == '\n') { line[-- len] = '\0'; }
+		if(len == 0) { continue; }
+
+		/* or the child writes the buffered output again */
+		fflush(NULL);
+
+		pid = fork();
+		if(pid == 0) { run_child(line, out, timeout); }
+		if(pid < 0) {
+			dprintf(out, "exit -1\n");
+			continue;
+		}
+		while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+		code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		m_requests.count ++;
+		if(WIFSIGNALED(status)) { m_crashes.count ++; }
+		else if(code == EXIT_TIMEOUT) { m_timeouts.count ++; }
+		else if(code == 0) { m_good.count ++; }
+		else if(code == 1) { m_bad.count ++; }
+		metric_observe(&m_latency, now_us() - start);
+
+		dprintf(out, "exit %d\n", code);
+	}
+
+	free(line);
+	fclose(fp);
+}
+
+bool fork_server(const char *path, unsigned timeout) {
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	int fd;
+
+	metric_register(&m_requests);
+	metric_register(&m_good);
+	metric_register(&m_bad);
+	metric_register(&m_timeouts);
+	metric_register(&m_crashes);
+	metric_register(&m_latency);
+
+	output_offsets(&trace_base, &log_base);
+
+	/* a client that went away does not stop the server */
+	signal(SIGPIPE, SIG_IGN);
+
+	if(strcmp(path, "-") == 0) {
+		serve(STDIN_FILENO, STDOUT_FILENO, timeout);
+		return true;
+	}
+
+	if(strlen(path) >= sizeof(addr.sun_path)) { return false; }
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0) { return false; }
+	unlink(path);
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+		close(fd);
+		return false;
+	}
+
+	/* not restarted, so that accept() returns */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	printf("Fork server listening on %s\n", path);
+	fflush(stdout);
+	while(!stopping) {
+		int conn = accept(fd, NULL, NULL);
+		if(conn < 0) {
+			if(errno == EINTR) { continue; }
+			break;
+		}
+		serve(conn, conn, timeout);
+		close(conn);
+	}
+
+	close(fd);
+	unlink(path);
+	return true;
+}
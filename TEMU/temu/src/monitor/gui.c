@@ -4,6 +4,14 @@
 #include "memory.h"
 #include "monitor/command.h"
 #include "monitor/monitor.h"
+#include "perf/zone.h"
+#include "device/board.h"
+#include "cpu/disasm.h"
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <inttypes.h>
 
 // 全局GUI组件
 static GtkWidget *window;
@@ -12,93 +20,368 @@ static GtkWidget *code_text_view;
 static GtkWidget *mem_text_view;
 static GtkWidget *console_text_view;
 static GtkWidget *console_entry;
+static GtkWidget *board_label;
+static GtkWidget *status_label;
 static GtkTextBuffer *reg_buffer;
 static GtkTextBuffer *code_buffer;
 static GtkTextBuffer *mem_buffer;
 static GtkTextBuffer *console_buffer;
+static GtkAdjustment *mem_adj;
 
 // 定时器ID，用于定期更新界面
 static guint update_timer_id = 0;
 
-// 更新寄存器显示
-static void update_registers_display() {
+/* 模拟器核心运行在工作线程上，GTK主线程只负责界面：
+ * - 主线程通过无锁的单生产者单消费者命令队列发送命令；
+ * - 工作线程按RUN_SLICE条指令一段执行，每段之间处理命令并发布状态快照，
+ *   所以Stop在一段之内生效；
+ * - 快照由seqlock保护，界面读到的总是某一段结束时一致的状态。
+ * 除了handle_command()和内存视图读取可见的几行hw_mem，主线程不直接访问
+ * cpu、内存或设备。
+ */
+
+enum { GUI_CMD_RUN, GUI_CMD_STEP, GUI_CMD_STOP, GUI_CMD_RESET, GUI_CMD_MONITOR, GUI_CMD_QUIT };
+
+#define NR_GUI_CMD 64
+#define RUN_SLICE 4096
+
+typedef struct {
+    int type;
+    uint32_t n;        // GUI_CMD_STEP的指令条数
+    char line[128];    // GUI_CMD_MONITOR的命令行
+} GuiCommand;
+
+static GuiCommand cmd_ring[NR_GUI_CMD];
+static atomic_uint cmd_head, cmd_tail;   // head由工作线程推进，tail由主线程推进
+static sem_t cmd_sem;                    // 没有指令要执行时，工作线程在此等待
+static GThread *worker = NULL;
+
+#define NR_CODE_LINE 10
+
+/* 每个视图有自己的generation，内容变化时才增加，界面只重绘generation
+ * 变化了的视图，并且只改动变化了的寄存器、行和内存单元。
+ */
+typedef struct {
+    uint32_t generation;        // 每次发布快照都增加
+    uint32_t pc, gpr[32], reg_generation;
+    uint32_t code_start, code[NR_CODE_LINE], code_generation;
+    uint32_t board[NR_BOARD_REG], board_generation;
+    uint64_t nr_instr;
+    int state;
+    bool running;
+} Snapshot;
+
+static Snapshot snapshot;
+static atomic_uint snapshot_seq;   // 奇数表示工作线程正在写
+
+// 由主线程调用
+static bool post_command(int type, uint32_t n, const char *line) {
+    unsigned tail = atomic_load_explicit(&cmd_tail, memory_order_relaxed);
+    if(tail - atomic_load_explicit(&cmd_head, memory_order_acquire) == NR_GUI_CMD) return false;
+
+    GuiCommand *c = &cmd_ring[tail % NR_GUI_CMD];
+    c->type = type;
+    c->n = n;
+    snprintf(c->line, sizeof(c->line), "%s", line ? line : "");
+    atomic_store_explicit(&cmd_tail, tail + 1, memory_order_release);
+    sem_post(&cmd_sem);
+    return true;
+}
+
+// 由工作线程调用
+static bool take_command(GuiCommand *c) {
+    unsigned head = atomic_load_explicit(&cmd_head, memory_order_relaxed);
+    if(head == atomic_load_explicit(&cmd_tail, memory_order_acquire)) return false;
+
+    *c = cmd_ring[head % NR_GUI_CMD];
+    atomic_store_explicit(&cmd_head, head + 1, memory_order_release);
+    return true;
+}
+
+// 直接读hw_mem，不经过mem_read()，不影响DRAM和cache模型的统计
+static uint32_t peek_word(uint32_t addr) {
+    uint32_t paddr = addr & 0x7FFFFFFF, word;
+    if(paddr > HW_MEM_SIZE - 4) return 0;
+    memcpy(&word, hw_mem + paddr, 4);
+    return word;
+}
+
+// 由工作线程调用（启动前由主线程调用一次）
+static void publish_snapshot(bool running) {
+    unsigned seq = atomic_load_explicit(&snapshot_seq, memory_order_relaxed);
+    atomic_store_explicit(&snapshot_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    snapshot.generation++;
+
+    bool pc_changed = snapshot.pc != cpu.pc, changed = pc_changed;
+    snapshot.pc = cpu.pc;
+    for(int i = 0; i < 32; i++) {
+        changed |= snapshot.gpr[i] != reg_w(i);
+        snapshot.gpr[i] = reg_w(i);
+    }
+    if(changed) snapshot.reg_generation++;
+
+    // 显示PC附近的代码，PC离开窗口时才移动窗口，循环中只需移动PC标记
+    changed = snapshot.code_generation == 0;
+    if(cpu.pc - snapshot.code_start >= NR_CODE_LINE * 4) {
+        snapshot.code_start = cpu.pc - 16;
+        if(snapshot.code_start < 0x80000000) snapshot.code_start = 0x80000000;
+        changed = true;
+    }
+    for(int i = 0; i < NR_CODE_LINE; i++) {
+        uint32_t word = peek_word(snapshot.code_start + i * 4);
+        changed |= snapshot.code[i] != word;
+        snapshot.code[i] = word;
+    }
+    if(changed || pc_changed) snapshot.code_generation++;
+
+    for(int i = 0; i < NR_BOARD_REG; i++) snapshot.board[i] = board_get(i);
+    snapshot.board_generation = board_generation;
+    snapshot.nr_instr = nr_instr;
+    snapshot.state = temu_state;
+    snapshot.running = running;
+
+    atomic_store_explicit(&snapshot_seq, seq + 2, memory_order_release);
+}
+
+// 由主线程调用，工作线程写到一半时重读
+static void read_snapshot(Snapshot *s) {
+    unsigned seq;
+    do {
+        seq = atomic_load_explicit(&snapshot_seq, memory_order_acquire);
+        if(seq & 1) continue;
+        memcpy(s, &snapshot, sizeof(*s));
+        atomic_thread_fence(memory_order_acquire);
+    } while((seq & 1) || seq != atomic_load_explicit(&snapshot_seq, memory_order_relaxed));
+}
+
+// 把第line行第offset列起的len个字符换成text，highlight时标出变化
+static void replace_text(GtkTextBuffer *buffer, int line, int offset, int len, const char *text, bool highlight) {
     GtkTextIter start, end;
-    
-    gtk_text_buffer_get_start_iter(reg_buffer, &start);
-    gtk_text_buffer_get_end_iter(reg_buffer, &end);
-    gtk_text_buffer_delete(reg_buffer, &start, &end);
-    
-    // 格式化寄存器信息
-    char *reg_text = g_strdup_printf(
-        "PC: 0x%08x\n\n"
-        "General Purpose Registers:\n"
-        "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
-        "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
-        "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
-        "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
-        "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
-        "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
-        "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
-        "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n",
-        cpu.pc,
-        regfile[0], reg_w(0), regfile[1], reg_w(1), regfile[2], reg_w(2), regfile[3], reg_w(3),
-        regfile[4], reg_w(4), regfile[5], reg_w(5), regfile[6], reg_w(6), regfile[7], reg_w(7),
-        regfile[8], reg_w(8), regfile[9], reg_w(9), regfile[10], reg_w(10), regfile[11], reg_w(11),
-        regfile[12], reg_w(12), regfile[13], reg_w(13), regfile[14], reg_w(14), regfile[15], reg_w(15),
-        regfile[16], reg_w(16), regfile[17], reg_w(17), regfile[18], reg_w(18), regfile[19], reg_w(19),
-        regfile[20], reg_w(20), regfile[21], reg_w(21), regfile[22], reg_w(22), regfile[23], reg_w(23),
-        regfile[24], reg_w(24), regfile[25], reg_w(25), regfile[26], reg_w(26), regfile[27], reg_w(27),
-        regfile[28], reg_w(28), regfile[29], reg_w(29), regfile[30], reg_w(30), regfile[31], reg_w(31)
-    );
-    
-    gtk_text_buffer_set_text(reg_buffer, reg_text, -1);
-    g_free(reg_text);
-}
-
-// 更新代码显示
-static void update_code_display() {
-    // 显示当前PC附近的代码
-    char buffer[256];
-    uint32_t pc_start = cpu.pc - 16;
-    if(pc_start < 0x80000000) pc_start = 0x80000000;
-    
+    gtk_text_buffer_get_iter_at_line_offset(buffer, &start, line, offset);
+    gtk_text_buffer_get_iter_at_line_offset(buffer, &end, line, offset + len);
+    gtk_text_buffer_delete(buffer, &start, &end);
+    if(highlight) {
+        gtk_text_buffer_insert_with_tags_by_name(buffer, &start, text, -1, "changed", NULL);
+    } else {
+        gtk_text_buffer_insert(buffer, &start, text, -1);
+    }
+}
+
+// 去掉上一次标出的变化
+static void clear_highlight(GtkTextBuffer *buffer) {
     GtkTextIter start, end;
-    gtk_text_buffer_get_start_iter(code_buffer, &start);
-    gtk_text_buffer_get_end_iter(code_buffer, &end);
-    gtk_text_buffer_delete(code_buffer, &start, &end);
+    gtk_text_buffer_get_start_iter(buffer, &start);
+    gtk_text_buffer_get_end_iter(buffer, &end);
+    gtk_text_buffer_remove_tag_by_name(buffer, "changed", &start, &end);
+}
+
+// 每个寄存器占"%-6s: 0x%08x  "，值从第8列开始
+#define REG_CELL_WIDTH 20
+#define REG_FIRST_LINE 3
+
+// 更新寄存器显示，只改写变化了的寄存器
+static void update_registers_display(const Snapshot *s) {
+    static uint32_t shown_generation = 0;
+    static bool built = false;
+    static uint32_t shown_pc, shown_gpr[32];
+    char text[16];
+    
+    if(built && shown_generation == s->reg_generation) return;
+    
+    if(!built) {
+        // 第一次显示时格式化全部内容
+        char *reg_text = g_strdup_printf(
+            "PC: 0x%08x\n\n"
+            "General Purpose Registers:\n"
+            "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
+            "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
+            "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
+            "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
+            "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
+            "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
+            "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n"
+            "%-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x  %-6s: 0x%08x\n",
+            s->pc,
+            regfile[0], s->gpr[0], regfile[1], s->gpr[1], regfile[2], s->gpr[2], regfile[3], s->gpr[3],
+            regfile[4], s->gpr[4], regfile[5], s->gpr[5], regfile[6], s->gpr[6], regfile[7], s->gpr[7],
+            regfile[8], s->gpr[8], regfile[9], s->gpr[9], regfile[10], s->gpr[10], regfile[11], s->gpr[11],
+            regfile[12], s->gpr[12], regfile[13], s->gpr[13], regfile[14], s->gpr[14], regfile[15], s->gpr[15],
+            regfile[16], s->gpr[16], regfile[17], s->gpr[17], regfile[18], s->gpr[18], regfile[19], s->gpr[19],
+            regfile[20], s->gpr[20], regfile[21], s->gpr[21], regfile[22], s->gpr[22], regfile[23], s->gpr[23],
+            regfile[24], s->gpr[24], regfile[25], s->gpr[25], regfile[26], s->gpr[26], regfile[27], s->gpr[27],
+            regfile[28], s->gpr[28], regfile[29], s->gpr[29], regfile[30], s->gpr[30], regfile[31], s->gpr[31]
+        );
+        gtk_text_buffer_set_text(reg_buffer, reg_text, -1);
+        g_free(reg_text);
+        built = true;
+    } else {
+        clear_highlight(reg_buffer);
+        if(s->pc != shown_pc) {
+            snprintf(text, sizeof(text), "0x%08x", s->pc);
+            replace_text(reg_buffer, 0, 4, 10, text, true);
+        }
+        for(int i = 0; i < 32; i++) {
+            if(s->gpr[i] == shown_gpr[i]) continue;
+            snprintf(text, sizeof(text), "0x%08x", s->gpr[i]);
+            replace_text(reg_buffer, REG_FIRST_LINE + i / 4, (i % 4) * REG_CELL_WIDTH + 8, 10, text, true);
+        }
+    }
     
-    for(int i = 0; i < 10; i++) {
-        uint32_t addr = pc_start + i * 4;
-        if(addr >= 0x80010000) break; // 超出.text段
-        
-        uint32_t instr = mem_read(addr, 4);
-        // 简单显示，实际应该反汇编
-        if(addr == cpu.pc) {
-            snprintf(buffer, sizeof(buffer), "> 0x%08x: 0x%08x\n", addr, instr);
-        } else {
-            snprintf(buffer, sizeof(buffer), "  0x%08x: 0x%08x\n", addr, instr);
+    shown_generation = s->reg_generation;
+    shown_pc = s->pc;
+    memcpy(shown_gpr, s->gpr, sizeof(shown_gpr));
+}
+
+// 更新代码显示，窗口不变时只移动PC标记
+static void update_code_display(const Snapshot *s) {
+    static uint32_t shown_generation = 0, shown_start, shown_pc;
+    static uint32_t shown_code[NR_CODE_LINE];
+    
+    if(shown_generation == s->code_generation) return;
+    
+    if(shown_generation == 0 || s->code_start != shown_start ||
+       memcmp(s->code, shown_code, sizeof(shown_code)) != 0) {
+        // 窗口移动或代码被改写，重新反汇编这几行
+        char text[NR_CODE_LINE * 128];
+        int len = 0;
+        for(int i = 0; i < NR_CODE_LINE; i++) {
+            uint32_t addr = s->code_start + i * 4;
+            char assembly[80];
+            if(addr >= 0x80010000) break; // 超出.text段
+            
+            disasm(addr, s->code[i], assembly, sizeof(assembly));
+            len += snprintf(text + len, sizeof(text) - len, "%c 0x%08x: %08x  %s\n",
+                            addr == s->pc ? '>' : ' ', addr, s->code[i], assembly);
+        }
+        gtk_text_buffer_set_text(code_buffer, text, len);
+    } else {
+        if(shown_pc - s->code_start < NR_CODE_LINE * 4) {
+            replace_text(code_buffer, (shown_pc - s->code_start) / 4, 0, 1, " ", false);
+        }
+        if(s->pc - s->code_start < NR_CODE_LINE * 4) {
+            replace_text(code_buffer, (s->pc - s->code_start) / 4, 0, 1, ">", false);
         }
-        
-        gtk_text_buffer_insert_at_cursor(code_buffer, buffer, -1);
     }
+    
+    shown_generation = s->code_generation;
+    shown_start = s->code_start;
+    shown_pc = s->pc;
+    memcpy(shown_code, s->code, sizeof(shown_code));
+}
+
+/* 内存视图是虚拟化的：滚动条的范围覆盖整个hw_mem，文本中只有可见的
+ * NR_MEM_ROW行，每行"%08x:"加MEM_ROW_WORDS个字。只在滚动时格式化
+ * 这几行，运行中只改写值变化了的字。
+ */
+#define NR_MEM_ROW 24
+#define MEM_ROW_WORDS 4
+#define MEM_ROW_BYTES (MEM_ROW_WORDS * 4)
+#define MEM_VIEW_BASE 0x80000000
+
+static uint32_t mem_row_address() {
+    return MEM_VIEW_BASE + (uint32_t)gtk_adjustment_get_value(mem_adj) * MEM_ROW_BYTES;
 }
 
 // 更新内存显示
-static void update_memory_display() {
-    char buffer[128];
+static void update_memory_display(const Snapshot *s) {
+    static uint32_t shown_generation = 0, shown_base = 0;
+    static bool built = false;
+    static uint32_t shown[NR_MEM_ROW * MEM_ROW_WORDS];
+    uint32_t base = mem_row_address();
+    
+    if(!built || base != shown_base) {
+        char text[NR_MEM_ROW * (10 + MEM_ROW_WORDS * 9 + 1) + 1];
+        int len = 0;
+        for(int row = 0; row < NR_MEM_ROW; row++) {
+            uint32_t addr = base + row * MEM_ROW_BYTES;
+            len += snprintf(text + len, sizeof(text) - len, "%08x:", addr);
+            for(int i = 0; i < MEM_ROW_WORDS; i++) {
+                shown[row * MEM_ROW_WORDS + i] = peek_word(addr + i * 4);
+                len += snprintf(text + len, sizeof(text) - len, " %08x", shown[row * MEM_ROW_WORDS + i]);
+            }
+            text[len++] = '\n';
+        }
+        gtk_text_buffer_set_text(mem_buffer, text, len);
+        built = true;
+    } else if(shown_generation != s->generation) {
+        bool cleared = false;
+        for(int row = 0; row < NR_MEM_ROW; row++) {
+            for(int i = 0; i < MEM_ROW_WORDS; i++) {
+                uint32_t word = peek_word(base + row * MEM_ROW_BYTES + i * 4);
+                char text[16];
+                if(word == shown[row * MEM_ROW_WORDS + i]) continue;
+                
+                if(!cleared) {
+                    clear_highlight(mem_buffer);
+                    cleared = true;
+                }
+                shown[row * MEM_ROW_WORDS + i] = word;
+                snprintf(text, sizeof(text), "%08x", word);
+                replace_text(mem_buffer, row, 10 + i * 9, 8, text, true);
+            }
+        }
+    }
     
-    GtkTextIter start, end;
-    gtk_text_buffer_get_start_iter(mem_buffer, &start);
-    gtk_text_buffer_get_end_iter(mem_buffer, &end);
-    gtk_text_buffer_delete(mem_buffer, &start, &end);
-    
-    // 显示.data段内容
-    uint32_t addr = 0x80010000;
-    for(int i = 0; i < 16; i++) {
-        uint32_t value = mem_read(addr + i*4, 4);
-        snprintf(buffer, sizeof(buffer), "0x%08x: 0x%08x\n", addr + i*4, value);
-        gtk_text_buffer_insert_at_cursor(mem_buffer, buffer, -1);
+    shown_generation = s->generation;
+    shown_base = base;
+}
+
+static void on_mem_scrolled(GtkAdjustment *adj, gpointer data) {
+    Snapshot s;
+    read_snapshot(&s);
+    update_memory_display(&s);
+}
+
+// 鼠标滚轮在文本上滚动内存视图
+static gboolean on_mem_scroll_event(GtkWidget *widget, GdkEventScroll *event, gpointer data) {
+    double value = gtk_adjustment_get_value(mem_adj);
+    if(event->direction == GDK_SCROLL_UP) value -= 3;
+    else if(event->direction == GDK_SCROLL_DOWN) value += 3;
+    else return FALSE;
+    gtk_adjustment_set_value(mem_adj, value);
+    return TRUE;
+}
+
+// 更新开发板显示（LED、数码管），仅在状态变化时重绘
+static void update_board_display(const Snapshot *s) {
+    static uint32_t shown_generation = ~0u;
+    char text[128];
+    char leds[33];
+    uint32_t led = s->board[BOARD_LED];
+    
+    if(shown_generation == s->board_generation) return;
+    shown_generation = s->board_generation;
+    
+    for(int i = 0; i < 32; i++) {
+        leds[i] = (led >> (31 - i)) & 1 ? '*' : '.';
+    }
+    leds[32] = '\0';
+    snprintf(text, sizeof(text), "LED: %s    7-SEG: %x%08x    SW1: 0x%08x  SW2: 0x%08x  BTN: 0x%02x",
+             leds, s->board[BOARD_SEG_HI], s->board[BOARD_SEG],
+             s->board[BOARD_SW_1], s->board[BOARD_SW_2], s->board[BOARD_BTN]);
+    gtk_label_set_text(GTK_LABEL(board_label), text);
+}
+
+// 更新状态栏：PC、运行状态和指令执行速率
+static void update_status_display(const Snapshot *s) {
+    static uint64_t last_instr = 0;
+    static gint64 last_time = 0;
+    gint64 now = g_get_monotonic_time();
+    double mips = 0.0;
+    char text[160];
+    
+    if(last_time != 0 && now > last_time && s->nr_instr >= last_instr) {
+        mips = (double)(s->nr_instr - last_instr) / (now - last_time);
     }
+    last_instr = s->nr_instr;
+    last_time = now;
+    
+    snprintf(text, sizeof(text), "PC: 0x%08x    %s    %" PRIu64 " instructions    %.2f MIPS",
+             s->pc, s->state == END ? "ended" : s->running ? "running" : "stopped",
+             s->nr_instr, s->running ? mips : 0.0);
+    gtk_label_set_text(GTK_LABEL(status_label), text);
 }
 
 // 向控制台添加输出
@@ -124,58 +407,153 @@ void gui_console_printf(const char *format, ...) {
 
 // 定时更新界面
 static gboolean update_display_callback(gpointer data) {
-    update_registers_display();
-    update_code_display();
-    update_memory_display();
+    ZONE("update_display_callback");
+    static uint32_t shown_generation = 0;
+    Snapshot s;
+    read_snapshot(&s);
+    // 工作线程没有发布新的快照，什么都不用做
+    if(shown_generation == s.generation) return TRUE;
+    shown_generation = s.generation;
+    update_registers_display(&s);
+    update_code_display(&s);
+    update_memory_display(&s);
+    update_board_display(&s);
+    update_status_display(&s);
     return TRUE; // 继续定时器
 }
 
+// 以下几个idle回调由工作线程通过g_idle_add()交给主线程执行
+static gboolean refresh_idle(gpointer data) {
+    update_display_callback(NULL);
+    return FALSE;
+}
+
+static gboolean console_idle(gpointer data) {
+    gui_console_printf("%s", (char *)data);
+    g_free(data);
+    return FALSE;
+}
+
+static gboolean quit_idle(gpointer data) {
+    gtk_main_quit();
+    return FALSE;
+}
+
+// 由工作线程调用
+static void worker_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    g_idle_add(console_idle, g_strdup_vprintf(format, args));
+    va_end(args);
+}
+
+// 重新装入程序，寄存器清零，golden trace从头记录
+static void reset_program() {
+    close_trace();
+    init_trace();
+    // 在restart()之前清零，定时器事件和倒退的检查点0都从干净的状态开始
+    nr_instr = 0;
+    guest_exit_code = 0;
+    guest_touched_host = false;
+    memset(cpu.gpr, 0, sizeof(cpu.gpr));
+    cpu.hi = cpu.lo = 0;
+    restart();
+    temu_state = STOP;
+}
+
+static gpointer worker_main(gpointer data) {
+    GuiCommand c;
+    uint64_t remaining = 0;    // 还要执行的指令条数，UINT64_MAX表示一直运行到结束
+    
+    for(;;) {
+        if(remaining == 0) sem_wait(&cmd_sem);
+        
+        bool handled = false;
+        while(take_command(&c)) {
+            handled = true;
+            switch(c.type) {
+                case GUI_CMD_RUN:
+                    if(remaining == 0) remaining = UINT64_MAX;
+                    break;
+                case GUI_CMD_STEP:
+                    if(remaining == 0) remaining = c.n;
+                    break;
+                case GUI_CMD_STOP:
+                    if(remaining != 0) worker_printf("Stopped at $pc = 0x%08x\n", cpu.pc);
+                    remaining = 0;
+                    break;
+                case GUI_CMD_RESET:
+                    remaining = 0;
+                    reset_program();
+                    worker_printf("Program reloaded.\n");
+                    break;
+                case GUI_CMD_MONITOR:
+                    if(handle_command(c.line) < 0) g_idle_add(quit_idle, NULL);
+                    break;
+                case GUI_CMD_QUIT:
+                    return NULL;
+            }
+        }
+        
+        if(remaining != 0) {
+            uint32_t n = remaining < RUN_SLICE ? remaining : RUN_SLICE;
+            uint64_t start = nr_instr;
+            cpu_exec(n);
+            if(temu_state == END || nr_instr - start < n) {
+                // 程序结束，或者触发了监视点
+                remaining = 0;
+                if(temu_state != END) worker_printf("Stopped at $pc = 0x%08x\n", cpu.pc);
+            }
+            else if(remaining != UINT64_MAX) {
+                remaining -= n;
+            }
+            handled = handled || remaining == 0;
+        }
+        
+        publish_snapshot(remaining != 0);
+        // 运行中由定时器刷新，停下来时立即刷新一次
+        if(handled) g_idle_add(refresh_idle, NULL);
+    }
+}
+
 // 控制台命令处理
 static void console_command_execute() {
     const char *command = gtk_entry_get_text(GTK_ENTRY(console_entry));
     gui_console_printf("(temu) %s\n", command);
     
-    // 调用命令处理器
-    int result = handle_command(command);
-    
-    if(result == -1) {
-        gtk_main_quit(); // q命令退出
+    // c和si交给工作线程分段执行，以便随时停止；其他命令由工作线程调用命令处理器
+    while(*command == ' ') command++;
+    if(strcmp(command, "c") == 0) {
+        post_command(GUI_CMD_RUN, 0, NULL);
+    } else if(strncmp(command, "si", 2) == 0 && (command[2] == '\0' || command[2] == ' ')) {
+        int n = command[2] ? atoi(command + 2) : 1;
+        post_command(GUI_CMD_STEP, n > 0 ? n : 1, NULL);
+    } else if(!post_command(GUI_CMD_MONITOR, 0, command)) {
+        gui_console_printf("Busy, try again.\n");
     }
     
-    // 更新显示
-    update_registers_display();
-    update_code_display();
-    update_memory_display();
-    
     gtk_entry_set_text(GTK_ENTRY(console_entry), "");
 }
 
 // 修改工具栏按钮回调
 static void on_run_clicked(GtkWidget *widget, gpointer data) {
     gui_console_printf("Running program...\n");
-    handle_command("c");
-    update_registers_display();
-    update_code_display();
-    update_memory_display();
+    post_command(GUI_CMD_RUN, 0, NULL);
 }
 
 static void on_step_clicked(GtkWidget *widget, gpointer data) {
     gui_console_printf("Stepping one instruction...\n");
-    handle_command("si");
-    update_registers_display();
-    update_code_display();
-    update_memory_display();
+    post_command(GUI_CMD_STEP, 1, NULL);
 }
 
 static void on_stop_clicked(GtkWidget *widget, gpointer data) {
     gui_console_printf("Stop requested.\n");
-    // 设置停止状态
-    extern int temu_state;
-    temu_state = STOP;
+    post_command(GUI_CMD_STOP, 0, NULL);
 }
 
 static void on_reset_clicked(GtkWidget *widget, gpointer data) {
-    gui_console_printf("Reset requested (not implemented).\n");
+    gui_console_printf("Reset requested.\n");
+    post_command(GUI_CMD_RESET, 0, NULL);
 }
 
 // 创建主界面
@@ -234,6 +612,7 @@ static void create_main_window() {
     reg_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(reg_text_view));
     gtk_container_add(GTK_CONTAINER(reg_scroll), reg_text_view);
     gtk_container_add(GTK_CONTAINER(reg_frame), reg_scroll);
+    gtk_text_buffer_create_tag(reg_buffer, "changed", "background", "yellow", NULL);
     
     // 代码面板
     GtkWidget *code_frame = gtk_frame_new("Code");
@@ -252,15 +631,23 @@ static void create_main_window() {
     // 右面板（垂直分割：内存和控制台）
     GtkWidget *right_vpaned = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
     
-    // 内存面板
+    // 内存面板，初始显示.data段
     GtkWidget *mem_frame = gtk_frame_new("Memory");
-    GtkWidget *mem_scroll = gtk_scrolled_window_new(NULL, NULL);
+    GtkWidget *mem_hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    mem_adj = gtk_adjustment_new((0x80010000 - MEM_VIEW_BASE) / MEM_ROW_BYTES, 0,
+                                 HW_MEM_SIZE / MEM_ROW_BYTES, 1, NR_MEM_ROW, NR_MEM_ROW);
+    GtkWidget *mem_scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, mem_adj);
     mem_text_view = gtk_text_view_new();
     gtk_text_view_set_editable(GTK_TEXT_VIEW(mem_text_view), FALSE);
     gtk_text_view_set_monospace(GTK_TEXT_VIEW(mem_text_view), TRUE);
     mem_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(mem_text_view));
-    gtk_container_add(GTK_CONTAINER(mem_scroll), mem_text_view);
-    gtk_container_add(GTK_CONTAINER(mem_frame), mem_scroll);
+    gtk_text_buffer_create_tag(mem_buffer, "changed", "background", "yellow", NULL);
+    gtk_widget_add_events(mem_text_view, GDK_SCROLL_MASK);
+    g_signal_connect(mem_text_view, "scroll-event", G_CALLBACK(on_mem_scroll_event), NULL);
+    g_signal_connect(mem_adj, "value-changed", G_CALLBACK(on_mem_scrolled), NULL);
+    gtk_box_pack_start(GTK_BOX(mem_hbox), mem_text_view, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(mem_hbox), mem_scrollbar, FALSE, FALSE, 0);
+    gtk_container_add(GTK_CONTAINER(mem_frame), mem_hbox);
     
     // 控制台面板
     GtkWidget *console_frame = gtk_frame_new("Console");
@@ -305,6 +692,12 @@ static void create_main_window() {
     // 组装界面
     gtk_box_pack_start(GTK_BOX(vbox), menu_bar, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(vbox), toolbar, FALSE, FALSE, 0);
+    
+    // 开发板面板和状态栏
+    board_label = gtk_label_new("");
+    status_label = gtk_label_new("");
+    gtk_box_pack_start(GTK_BOX(vbox), board_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), status_label, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(vbox), hpaned, TRUE, TRUE, 0);
     
     // 启动定时器，每秒更新4次
@@ -316,15 +709,15 @@ void init_gui(int *argc, char ***argv) {
     gtk_init(argc, argv);
     create_main_window();
     
-    // 初始显示
-    update_registers_display();
-    update_code_display();
-    update_memory_display();
+    // 工作线程启动前发布初始状态
+    publish_snapshot(false);
+    update_display_callback(NULL);
     gui_console_printf("TEMU Simulator started. Type 'help' for commands.\n");
-    gui_console_printf("Note: GUI mode currently shows interface only.\n");
-    gui_console_printf("Use console mode for full functionality.\n");
     
     gtk_widget_show_all(window);
+    
+    sem_init(&cmd_sem, 0, 0);
+    worker = g_thread_new("temu-cpu", worker_main, NULL);
 }
 
 // 运行GUI主循环
@@ -338,4 +731,12 @@ void close_gui() {
         g_source_remove(update_timer_id);
         update_timer_id = 0;
     }
+    
+    // 工作线程在当前一段指令执行完后退出
+    if(worker != NULL) {
+        while(!post_command(GUI_CMD_QUIT, 0, NULL)) g_usleep(1000);
+        g_thread_join(worker);
+        worker = NULL;
+        sem_destroy(&cmd_sem);
+    }
 }
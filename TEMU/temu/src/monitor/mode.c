@@ -0,0 +1,100 @@
+#include "monitor/mode.h"
+#include "monitor/monitor.h"
+#include "monitor/watchpoint.h"
+#include "monitor/reverse.h"
+#include "perf/observer.h"
+#include "perf/metrics.h"
+#include "device/event.h"
+#include "temu.h"
+
+#include <inttypes.h>
+
+bool fast_forward = false;
+uint32_t mode_pc = MODE_NO_PC;
+
+static bool pc_to_fast, instr_to_fast;
+static uint64_t mode_instr;		/* due time of the instruction count trigger, 0 if none */
+
+/* instructions run in the fast-forward mode before the latest switch */
+static uint64_t fast_instr, fast_since;
+
+uint64_t mode_fast_instructions() {
+	return fast_instr + (fast_forward ? nr_instr - fast_since : 0);
+}
+
+static double fast_instructions() {
+	return mode_fast_instructions();
+}
+
+static Metric m_fast = { .name = "mode.fast_forward_instructions", .unit = "instructions", .type = METRIC_GAUGE, .read = fast_instructions };
+static Metric m_switches = { .name = "mode.switches", .unit = "switches", .type = METRIC_COUNTER };
+
+void init_mode() {
+	metric_register(&m_fast);
+	metric_register(&m_switches);
+}
+
+void mode_set(bool fast) {
+	if(fast == fast_forward) { return; }
+
+	if(fast) {
+		/* the history would not match the golden trace */
+		if(reverse_enabled) { reverse_disable(); }
+		fast_since = nr_instr;
+		dram_set_model(false);
+		observers_suspend();
+	}
+	else {
+		fast_instr += nr_instr - fast_since;
+		observers_resume();
+		dram_set_model(true);
+		/* the changes during the fast-forward are not reported */
+		wp_rebase();
+	}
+	fast_forward = fast;
+	m_switches.count ++;
+}
+
+static void report_switch(const char *why) {
+	printf("%s mode at instruction %" PRIu64 ", $pc = 0x%08x (%s)\n",
+			fast_forward ? "Fast-forward" : "Detailed", nr_instr, cpu.pc, why);
+}
+
+void mode_pc_reached() {
+	mode_pc = MODE_NO_PC;
+	mode_set(pc_to_fast);
+	report_switch("pc trigger");
+}
+
+static void mode_event(void *arg) {
+	mode_instr = 0;
+	mode_set(instr_to_fast);
+	report_switch("instruction trigger");
+}
+
+void mode_at_pc(uint32_t pc, bool fast) {
+	mode_pc = pc;
+	pc_to_fast = fast;
+}
+
+void mode_at_instr(uint64_t when, bool fast) {
+	if(mode_instr != 0) { event_cancel(mode_event, NULL); }
+	mode_instr = when;
+	instr_to_fast = fast;
+	event_schedule(when, mode_event, NULL);
+}
+
+bool mode_fast_forwarded() {
+	return fast_forward || fast_instr > 0;
+}
+
+void mode_report(FILE *fp) {
+	fprintf(fp, "%s mode, %.0f of %" PRIu64 " instructions fast-forwarded\n",
+			fast_forward ? "Fast-forward" : "Detailed", fast_instructions(), nr_instr);
+	if(mode_pc != MODE_NO_PC) {
+		fprintf(fp, "  %s at $pc = 0x%08x\n", pc_to_fast ? "fast-forward" : "detailed", mode_pc);
+	}
+	if(mode_instr != 0) {
+		fprintf(fp, "  %s after instruction %" PRIu64 "\n", instr_to_fast ? "fast-forward" : "detailed", mode_instr);
+	}
+}
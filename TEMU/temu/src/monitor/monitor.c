@@ -1,12 +1,30 @@
 #include "temu.h"
+#include "perf/zone.h"
+#include "perf/metrics.h"
+#include "device/mmio.h"
+#include "device/event.h"
+#include "device/semihost.h"
+#include "device/board.h"
+#include "cp0.h"
+#include "fusion.h"
+#include "perf/observer.h"
+#include "monitor/trace.h"
+#include "monitor/reverse.h"
+#include "monitor/mode.h"
+
+#include <unistd.h>
 
 #define ENTRY_START 0x80000000
 
 char *exec_file;
 
 void init_regex();
+void init_cpu_metrics();
 void init_wp_pool();
 void init_ddr3();
+void init_machine();
+void reset_machine();
+void init_mode();
 
 FILE *log_fp = NULL;
 
@@ -22,7 +40,27 @@ static void welcome() {
 
 static FILE *trace_fp = NULL;
 
+bool trace_binary = false;
+
+static Metric m_trace_records = { .name = "trace.records", .unit = "records", .type = METRIC_COUNTER };
+static Metric m_trace_bytes = { .name = "trace.bytes_written", .unit = "bytes", .type = METRIC_COUNTER };
+
 void init_trace() {
+    metric_register(&m_trace_records);
+    metric_register(&m_trace_bytes);
+
+    if(trace_binary) {
+        trace_fp = fopen("golden_trace.bin", "wb");
+        if(trace_fp == NULL) {
+            printf("Warning: Cannot open golden_trace.bin for writing\n");
+        } else {
+            /* flushed when cpu_exec() returns, not after every record */
+            setvbuf(trace_fp, NULL, _IOFBF, 1 << 20);
+            fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, trace_fp);
+        }
+        return;
+    }
+
     trace_fp = fopen("golden_trace.txt", "w");
     if(trace_fp == NULL) {
         printf("Warning: Cannot open golden_trace.txt for writing\n");
@@ -32,6 +70,10 @@ void init_trace() {
     }
 }
 
+void flush_trace() {
+    if(trace_fp != NULL) { fflush(trace_fp); }
+}
+
 void close_trace() {
     if(trace_fp != NULL) {
         fclose(trace_fp);
@@ -39,10 +81,41 @@ void close_trace() {
     }
 }
 
+/* The offsets of the golden trace and log.txt, and cutting them back to
+ * earlier offsets, when reverse.c goes back in the run. -1 if not open.
+ */
+void output_offsets(long *trace_off, long *log_off) {
+    *trace_off = trace_fp != NULL ? ftell(trace_fp) : -1;
+    *log_off = log_fp != NULL ? ftell(log_fp) : -1;
+}
+
+static void truncate_file(FILE *fp, long off) {
+    if(fp == NULL || off < 0) { return; }
+    fflush(fp);
+    if(ftruncate(fileno(fp), off) == 0) { fseek(fp, off, SEEK_SET); }
+}
+
+void output_rewind(long trace_off, long log_off) {
+    truncate_file(trace_fp, trace_off);
+    truncate_file(log_fp, log_off);
+}
+
 void record_trace(uint32_t pc, int reg_num, uint32_t value) {
-    if(trace_fp != NULL) {
-        fprintf(trace_fp, "%08x  %02d          %08x\n", pc, reg_num, value);
+    ZONE("record_trace");
+    /* the golden trace only covers the detailed mode, see mode.h */
+    if(fast_forward) { return; }
+    notify_observers(writeback, pc, reg_num, value);
+    if(trace_fp != NULL && trace_binary) {
+        TraceRecord rec = { .pc = pc, .reg = reg_num, .value = value };
+        fwrite(&rec, sizeof(rec), 1, trace_fp);
+        m_trace_records.count ++;
+        m_trace_bytes.count += sizeof(rec);
+    }
+    else if(trace_fp != NULL) {
+        int len = fprintf(trace_fp, "%08x  %02d          %08x\n", pc, reg_num, value);
 	fflush(trace_fp);
+        m_trace_records.count ++;
+        if(len > 0) { m_trace_bytes.count += len; }
     }
 }
 
@@ -56,17 +129,40 @@ void init_monitor(int argc, char *argv[]) {
 	/* Open trace file */
     	init_trace();
 
+	init_machine();
+	init_mode();
+
+	/* Keep the history for `rsi' and `rc'. */
+	reverse_enabled = true;
+
+	/* Display welcome message. */
+	welcome();
+}
+
+/* The part of init_monitor() that libtemu needs as well, it does not open
+ * log.txt or golden_trace.txt.
+ */
+void init_machine() {
+	static bool initialized = false;
+	if(initialized) { return; }
+	initialized = true;
+
 	/* Compile the regular expressions. */
 	init_regex();
 
 	/* Initialize the watchpoint pool. */
 	init_wp_pool();
 
-	/* Display welcome message. */
-	welcome();
+	/* Register the metrics of the execution loop. */
+	init_cpu_metrics();
+	init_fusion();
+
+	/* Map the devices. */
+	init_device();
 }
 
 static void load_entry() {
+	ZONE("load_entry");
 	int ret;
 
 	FILE *fp = fopen("inst.bin", "rb");
@@ -76,6 +172,7 @@ static void load_entry() {
 	fseek(fp, 0, SEEK_SET);
 	ret = fread((void *)(hw_mem + (ENTRY_START & 0x7FFFFFFF)), file_size, 1, fp);  // load .text segment to memory address 0x1fc00000
 	assert(ret == 1);
+	fclose(fp);
 
 	fp = fopen("data.bin", "rb");
 	Assert(fp, "Can not open 'data.bin'");
@@ -88,15 +185,36 @@ static void load_entry() {
 }
 
 void restart() {
+	ZONE("restart");
+
 	/* Perform some initialization to restart a program */
 
 	/* Read the entry code into memory. */
 	load_entry();
 
+	reset_machine();
+}
+
+/* Reset the CPU and the devices, the memory and the GPRs are kept. */
+void reset_machine() {
 	/* Set the initial instruction pointer. */
 	cpu.pc = ENTRY_START;
 
-	/* Initialize DRAM. */
+	/* Initialize DRAM, the memory may have been loaded again. */
 	init_ddr3();
+	fusion_flush();
+
+	/* Drop the pending events and reset coprocessor 0, which schedules the timer. */
+	event_reset();
+	init_cp0();
+
+	/* Close the files the guest left open. */
+	semihost_reset();
+
+	/* Clear the LEDs, the digits and the inputs of the board. */
+	board_reset();
+
+	/* The history for reverse execution starts here. */
+	reverse_reset();
 }
 
@@ -0,0 +1,342 @@
+#include "monitor/reverse.h"
+#include "monitor/monitor.h"
+#include "monitor/watchpoint.h"
+#include "device/event.h"
+#include "perf/metrics.h"
+#include "temu.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#define PAGE_BYTES 4096
+#define NR_BLOB 16
+
+typedef struct page {
+	uint32_t paddr;
+	struct page *next;
+	uint8_t data[PAGE_BYTES];
+} Page;
+
+typedef struct {
+	uint64_t nr_instr;
+	long trace_off, log_off;
+	uint8_t *state;		/* the registered blobs, one after the other */
+	Page *pages;		/* old contents of the pages written after the checkpoint */
+} Checkpoint;
+
+static struct {
+	void *ptr;
+	size_t size;
+} blobs[NR_BLOB];
+static int nr_blob = 0;
+static size_t state_size = 0;
+
+static Checkpoint *ckpts = NULL;
+static int nr_ckpt = 0, max_ckpt = 0;
+static uint64_t interval = REVERSE_INTERVAL;
+static uint64_t nr_byte = 0;
+
+bool reverse_enabled = false;
+bool replaying = false;
+uint8_t reverse_dirty[REVERSE_NR_PAGES];
+
+static double history_bytes() { return nr_byte; }
+static double history_interval() { return interval; }
+
+static Metric m_ckpts = { .name = "reverse.checkpoints", .unit = "checkpoints", .type = METRIC_COUNTER };
+static Metric m_pages = { .name = "reverse.pages_saved", .unit = "pages", .type = METRIC_COUNTER };
+static Metric m_replayed = { .name = "reverse.replayed_instructions", .unit = "instructions", .type = METRIC_COUNTER };
+static Metric m_bytes = { .name = "reverse.history_bytes", .unit = "bytes", .type = METRIC_GAUGE, .read = history_bytes };
+static Metric m_interval = { .name = "reverse.interval", .unit = "instructions", .type = METRIC_GAUGE, .read = history_interval };
+
+void reverse_register(void *ptr, size_t size) {
+	int i;
+	for(i = 0; i < nr_blob; i ++) {
+		if(blobs[i].ptr == ptr) { return; }
+	}
+
+	Assert(nr_blob < NR_BLOB, "Too many blobs of reverse execution state");
+	Assert(nr_ckpt == 0, "reverse execution state registered after the first checkpoint");
+	blobs[nr_blob].ptr = ptr;
+	blobs[nr_blob].size = size;
+	nr_blob ++;
+	state_size += size;
+}
+
+static void free_pages(Checkpoint *c) {
+	Page *p, *next;
+	for(p = c->pages; p != NULL; p = next) {
+		next = p->next;
+		free(p);
+		nr_byte -= sizeof(Page);
+	}
+	c->pages = NULL;
+}
+
+static void free_checkpoint(Checkpoint *c) {
+	free_pages(c);
+	free(c->state);
+	nr_byte -= state_size;
+}
+
+static void take_checkpoint() {
+	Checkpoint *c;
+	Page *p;
+	size_t off = 0;
+	int i;
+
+	/* the pages written from now on go to the new checkpoint */
+	if(nr_ckpt > 0) {
+		for(p = ckpts[nr_ckpt - 1].pages; p != NULL; p = p->next) {
+			reverse_dirty[p->paddr >> 12] = 0;
+		}
+	}
+
+	if(nr_ckpt == max_ckpt) {
+		max_ckpt = max_ckpt ? max_ckpt * 2 : 256;
+		ckpts = realloc(ckpts, max_ckpt * sizeof(Checkpoint));
+		Assert(ckpts, "Out of memory for the checkpoints");
+	}
+
+	c = &ckpts[nr_ckpt ++];
+	c->nr_instr = nr_instr;
+	output_offsets(&c->trace_off, &c->log_off);
+	c->pages = NULL;
+	c->state = malloc(state_size);
+	Assert(c->state, "Out of memory for the checkpoints");
+	for(i = 0; i < nr_blob; i ++) {
+		memcpy(c->state + off, blobs[i].ptr, blobs[i].size);
+		off += blobs[i].size;
+	}
+	nr_byte += state_size;
+	m_ckpts.count ++;
+}
+
+/* Drop every other checkpoint but the first one. The pages saved after
+ * a dropped checkpoint go to the one before it, unless that one has a
+ * copy of the page already, which is older.
+ */
+static void thin_history() {
+	static uint8_t seen[REVERSE_NR_PAGES];
+	Page *p, *next;
+	int i, n = 1;
+
+	for(i = 1; i < nr_ckpt; i ++) {
+		Checkpoint *into = &ckpts[n - 1], *c = &ckpts[i];
+		if(i % 2 == 0) {
+			ckpts[n ++] = *c;
+			continue;
+		}
+
+		for(p = into->pages; p != NULL; p = p->next) { seen[p->paddr >> 12] = 1; }
+		for(p = c->pages; p != NULL; p = next) {
+			next = p->next;
+			if(seen[p->paddr >> 12]) {
+				free(p);
+				nr_byte -= sizeof(Page);
+			}
+			else {
+				p->next = into->pages;
+				into->pages = p;
+			}
+		}
+		for(p = into->pages; p != NULL; p = p->next) { seen[p->paddr >> 12] = 0; }
+
+		c->pages = NULL;
+		free_checkpoint(c);
+	}
+	nr_ckpt = n;
+	interval *= 2;
+
+	/* the latest checkpoint may have taken the pages of a dropped one */
+	memset(reverse_dirty, 0, sizeof(reverse_dirty));
+	for(p = ckpts[nr_ckpt - 1].pages; p != NULL; p = p->next) {
+		reverse_dirty[p->paddr >> 12] = 1;
+	}
+}
+
+static void checkpoint_event(void *arg) {
+	/* scheduled first, so that the checkpoint holds the next one */
+	event_schedule(nr_instr + interval, checkpoint_event, NULL);
+	take_checkpoint();
+
+	while(nr_byte > REVERSE_BUDGET && nr_ckpt > 1) { thin_history(); }
+}
+
+void reverse_save_page(uint32_t paddr) {
+	uint32_t page = paddr >> 12;
+	Page *p;
+
+	reverse_dirty[page] = 1;
+	if(nr_ckpt == 0) { return; }
+
+	p = malloc(sizeof(Page));
+	Assert(p, "Out of memory for the checkpoints");
+	p->paddr = page << 12;
+	memcpy(p->data, hw_mem + p->paddr, PAGE_BYTES);
+	p->next = ckpts[nr_ckpt - 1].pages;
+	ckpts[nr_ckpt - 1].pages = p;
+	nr_byte += sizeof(Page);
+	m_pages.count ++;
+}
+
+void reverse_reset() {
+	int i;
+
+	metric_register(&m_ckpts);
+	metric_register(&m_pages);
+	metric_register(&m_replayed);
+	metric_register(&m_bytes);
+	metric_register(&m_interval);
+
+	for(i = 0; i < nr_ckpt; i ++) { free_checkpoint(&ckpts[i]); }
+	nr_ckpt = 0;
+
+	reverse_register(&cpu, sizeof(cpu));
+	reverse_register(&nr_instr, sizeof(nr_instr));
+	interval = REVERSE_INTERVAL;
+	memset(reverse_dirty, 0, sizeof(reverse_dirty));
+
+	if(!reverse_enabled) { return; }
+
+	event_schedule(nr_instr + interval, checkpoint_event, NULL);
+	take_checkpoint();
+}
+
+void reverse_disable() {
+	int i;
+
+	event_cancel(checkpoint_event, NULL);
+	for(i = 0; i < nr_ckpt; i ++) { free_checkpoint(&ckpts[i]); }
+	nr_ckpt = 0;
+	reverse_enabled = false;
+}
+
+/* the latest checkpoint at or before `when', -1 if there is none */
+static int find_checkpoint(uint64_t when) {
+	int lo = 0, hi = nr_ckpt - 1;
+	if(nr_ckpt == 0 || ckpts[0].nr_instr > when) { return -1; }
+	while(lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if(ckpts[mid].nr_instr <= when) { lo = mid; }
+		else { hi = mid - 1; }
+	}
+	return lo;
+}
+
+/* Put the machine back to checkpoint `k', the later ones are dropped. */
+static void restore(int k) {
+	Page *p;
+	size_t off = 0;
+	int i;
+
+	/* newest first, so that the page has its contents at checkpoint k in the end */
+	for(i = nr_ckpt - 1; i >= k; i --) {
+		for(p = ckpts[i].pages; p != NULL; p = p->next) {
+			memcpy(hw_mem + p->paddr, p->data, PAGE_BYTES);
+			dram_invalidate(p->paddr, PAGE_BYTES);
+			reverse_dirty[p->paddr >> 12] = 0;
+		}
+		if(i > k) { free_checkpoint(&ckpts[i]); }
+	}
+	free_pages(&ckpts[k]);
+	nr_ckpt = k + 1;
+
+	for(i = 0; i < nr_blob; i ++) {
+		memcpy(blobs[i].ptr, ckpts[k].state + off, blobs[i].size);
+		off += blobs[i].size;
+	}
+	output_rewind(ckpts[k].trace_off, ckpts[k].log_off);
+
+	temu_state = STOP;
+	guest_exit_code = 0;
+}
+
+/* Run forward to `target' again. Return the latest instruction count at
+ * which a watchpoint changed on the way, 0 if none did.
+ */
+static uint64_t replay_to(uint64_t target) {
+	uint64_t start = nr_instr, hit = 0;
+
+	replaying = true;
+	while(nr_instr < target && temu_state != END && !timed_out) {
+		uint64_t hits = wp_hits();
+		uint64_t n = target - nr_instr;
+		cpu_exec(n < 0x7fffffff ? n : 0x7fffffff);
+		if(wp_hits() != hits) { hit = nr_instr; }
+	}
+	replaying = false;
+
+	m_replayed.count += nr_instr - start;
+	return hit;
+}
+
+static bool can_reverse() {
+	if(nr_ckpt == 0) {
+		printf("No history is kept for reverse execution\n");
+		return false;
+	}
+	if(guest_touched_host) {
+		printf("The guest has read from the host, the run can not be repeated\n");
+		return false;
+	}
+	return true;
+}
+
+bool reverse_step(uint64_t n) {
+	uint64_t target;
+
+	if(!can_reverse()) { return false; }
+	if(n > nr_instr || nr_instr - n < ckpts[0].nr_instr) {
+		printf("The history starts at instruction %" PRIu64 "\n", ckpts[0].nr_instr);
+		return false;
+	}
+
+	target = nr_instr - n;
+	restore(find_checkpoint(target));
+	wp_set_mode(WP_OFF);
+	replay_to(target);
+	wp_set_mode(WP_ON);
+	wp_rebase();
+	return true;
+}
+
+bool reverse_continue() {
+	uint64_t end, hit = 0;
+	int k;
+
+	if(!can_reverse()) { return false; }
+
+	/* Replay the intervals from the latest one backwards, until one of
+	 * them has a change of a watchpoint. The change that stopped the run
+	 * at the current instruction is not counted.
+	 */
+	if(wp_active() && nr_instr > ckpts[0].nr_instr) {
+		end = nr_instr - 1;
+		for(k = find_checkpoint(end); k >= 0 && hit == 0; k --) {
+			uint64_t start = ckpts[k].nr_instr;
+			restore(k);
+			wp_rebase();
+			wp_set_mode(WP_QUIET);
+			hit = replay_to(end);
+			wp_set_mode(WP_ON);
+			end = start;
+		}
+	}
+
+	if(hit == 0) {
+		restore(0);
+		wp_rebase();
+		printf("No watchpoint changed, back at the start of the history\n");
+		return true;
+	}
+
+	/* run to the change again, check_wp() prints it */
+	restore(find_checkpoint(hit - 1));
+	wp_set_mode(WP_OFF);
+	replay_to(hit - 1);
+	wp_set_mode(WP_ON);
+	wp_rebase();
+	replay_to(hit);
+	return true;
+}
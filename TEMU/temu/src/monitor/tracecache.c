@@ -0,0 +1,239 @@
+#include "temu.h"
+#include "monitor.h"
+#include "monitor/trace.h"
+#include "monitor/tracecache.h"
+#include "monitor/mode.h"
+#include "device/uart.h"
+#include "perf/metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+/* An entry is a gzip stream of a CacheHeader, `console_len' bytes of
+ * UART output and `trace_len' bytes of golden trace, exactly as the run
+ * wrote golden_trace.txt or golden_trace.bin.
+ */
+
+#define CACHE_MAGIC "TEMUCCH1"
+
+typedef struct {
+	char magic[8];
+	uint64_t key;
+	uint64_t nr_instr;
+	int32_t exit_code;
+	uint32_t pc, hi, lo;
+	uint32_t gpr[32];
+	uint32_t cp0[32];
+	uint64_t console_len, trace_len;
+} CacheHeader;
+
+static const char *cache_dir = NULL;
+static uint64_t cache_key;
+static bool key_valid = false, served = false;
+static FILE *console_fp = NULL;
+
+static Metric m_hits = { .name = "trace_cache.hits", .unit = "runs", .type = METRIC_COUNTER };
+static Metric m_misses = { .name = "trace_cache.misses", .unit = "runs", .type = METRIC_COUNTER };
+static Metric m_stores = { .name = "trace_cache.stores", .unit = "runs", .type = METRIC_COUNTER };
+
+static const char *trace_file() {
+	return trace_binary ? "golden_trace.bin" : "golden_trace.txt";
+}
+
+/* 64-bit FNV-1a */
+static uint64_t hash_bytes(uint64_t h, const void *buf, size_t len) {
+	const uint8_t *p = buf;
+	size_t i;
+	for(i = 0; i < len; i ++) {
+		h = (h ^ p[i]) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+static bool hash_file(uint64_t *h, const char *filename) {
+	char buf[65536];
+	size_t n;
+	uint64_t size = 0;
+	FILE *fp = fopen(filename, "rb");
+	if(fp == NULL) { return false; }
+
+	while((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		*h = hash_bytes(*h, buf, n);
+		size += n;
+	}
+	fclose(fp);
+	/* the size separates the two images */
+	*h = hash_bytes(*h, &size, sizeof(size));
+	return true;
+}
+
+static bool compute_key() {
+	uint64_t h = 0xcbf29ce484222325ull;
+	if(!hash_file(&h, "inst.bin") || !hash_file(&h, "data.bin")) { return false; }
+	h = hash_bytes(h, TEMU_VERSION, sizeof(TEMU_VERSION));
+	h = hash_bytes(h, &trace_binary, sizeof(trace_binary));
+	cache_key = h;
+	return true;
+}
+
+static void entry_path(char *buf, size_t size) {
+	snprintf(buf, size, "%s/%016llx.gz", cache_dir, (unsigned long long)cache_key);
+}
+
+bool trace_cache_open(const char *dir) {
+	if(mkdir(dir, 0777) < 0 && errno != EEXIST) { return false; }
+	cache_dir = dir;
+
+	metric_register(&m_hits);
+	metric_register(&m_misses);
+	metric_register(&m_stores);
+	return true;
+}
+
+/* Copy `len' bytes from `in' to `out', which may be NULL to skip them. */
+static bool gz_copy(gzFile in, FILE *out, uint64_t len) {
+	char buf[65536];
+	while(len > 0) {
+		int n = gzread(in, buf, len < sizeof(buf) ? len : sizeof(buf));
+		if(n <= 0) { return false; }
+		if(out != NULL && fwrite(buf, 1, n, out) != n) { return false; }
+		len -= n;
+	}
+	return true;
+}
+
+bool trace_cache_load() {
+	char path[256];
+	CacheHeader h;
+	FILE *fp;
+	gzFile in;
+	int i;
+
+	if(cache_dir == NULL) { return false; }
+	key_valid = compute_key();
+	if(!key_valid) { return false; }
+
+	entry_path(path, sizeof(path));
+	in = gzopen(path, "rb");
+	if(in != NULL && (gzread(in, &h, sizeof(h)) != sizeof(h) ||
+			memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) != 0 || h.key != cache_key)) {
+		printf("Warning: Ignoring the damaged trace cache entry %s\n", path);
+		gzclose(in);
+		in = NULL;
+	}
+	if(in == NULL) {
+		m_misses.count ++;
+		/* keep the UART output for trace_cache_store() */
+		console_fp = tmpfile();
+		if(console_fp != NULL) { uart_capture(console_fp); }
+		return false;
+	}
+
+	/* the run has its output, the trace file opened by init_trace() is replaced */
+	fflush(stdout);
+	close_trace();
+	fp = fopen(trace_file(), "wb");
+	if(!gz_copy(in, stdout, h.console_len) || fp == NULL || !gz_copy(in, fp, h.trace_len)) {
+		printf("Warning: Cannot restore %s from %s\n", trace_file(), path);
+	}
+	if(fp != NULL) { fclose(fp); }
+	gzclose(in);
+
+	for(i = 0; i < 32; i ++) {
+		cpu.gpr[i]._32 = h.gpr[i];
+		cpu.cp0[i] = h.cp0[i];
+	}
+	cpu.pc = h.pc;
+	cpu.hi = h.hi;
+	cpu.lo = h.lo;
+	nr_instr = h.nr_instr;
+	guest_exit_code = h.exit_code;
+	temu_state = END;
+
+	served = true;
+	m_hits.count ++;
+	/* the trap is the instruction before the final pc */
+	printf("\33[1;31mtemu: HIT %s TRAP\33[0m at $pc = 0x%08x", h.exit_code == 0 ? "GOOD" : "BAD", h.pc - 4);
+	if(h.exit_code > 1) { printf(", exit code %d", h.exit_code); }
+	printf(" (cached, %llu instructions)\n\n", (unsigned long long)h.nr_instr);
+	return true;
+}
+
+void trace_cache_store() {
+	char path[256], tmp[300];
+	CacheHeader h;
+	FILE *fp;
+	gzFile out;
+	bool ok;
+	int i;
+
+	if(console_fp != NULL) { uart_capture(NULL); }
+	if(cache_dir == NULL || !key_valid || served || temu_state != END || guest_touched_host ||
+			mode_fast_forwarded() || console_fp == NULL) {
+		goto done;
+	}
+
+	/* the trace is complete once the file is closed */
+	close_trace();
+	fp = fopen(trace_file(), "rb");
+	if(fp == NULL) { goto done; }
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.key = cache_key;
+	h.nr_instr = nr_instr;
+	h.exit_code = guest_exit_code;
+	h.pc = cpu.pc;
+	h.hi = cpu.hi;
+	h.lo = cpu.lo;
+	for(i = 0; i < 32; i ++) {
+		h.gpr[i] = cpu.gpr[i]._32;
+		h.cp0[i] = cpu.cp0[i];
+	}
+	fseek(console_fp, 0, SEEK_END);
+	h.console_len = ftell(console_fp);
+	fseek(fp, 0, SEEK_END);
+	h.trace_len = ftell(fp);
+
+	/* write a temporary file and rename it, so that a concurrent run
+	 * never reads a partial entry
+	 */
+	entry_path(path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	out = gzopen(tmp, "wb6");
+	if(out == NULL) {
+		fclose(fp);
+		goto done;
+	}
+
+	ok = gzwrite(out, &h, sizeof(h)) == sizeof(h);
+	rewind(console_fp);
+	rewind(fp);
+	FILE *src[2] = { console_fp, fp };
+	for(i = 0; i < 2 && ok; i ++) {
+		char buf[65536];
+		size_t n;
+		while(ok && (n = fread(buf, 1, sizeof(buf), src[i])) > 0) {
+			ok = gzwrite(out, buf, n) == n;
+		}
+	}
+	fclose(fp);
+
+	if(gzclose(out) == Z_OK && ok && rename(tmp, path) == 0) {
+		m_stores.count ++;
+	}
+	else {
+		printf("Warning: Cannot write the trace cache entry %s\n", path);
+		unlink(tmp);
+	}
+
+done:
+	if(console_fp != NULL) {
+		fclose(console_fp);
+		console_fp = NULL;
+	}
+}
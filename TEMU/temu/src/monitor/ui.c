@@ -3,8 +3,23 @@
 #include "reg.h"
 #include "monitor/expr.h"
 #include "monitor/watchpoint.h"
+#include "monitor/reverse.h"
+#include "monitor/mode.h"
+#include "perf/timing.h"
+#include "perf/cache.h"
+#include "perf/bpred.h"
+#include "perf/profile.h"
+#include "perf/simpoint.h"
+#include "perf/zone.h"
+#include "perf/metrics.h"
+#include "device/mmio.h"
+#include "device/board.h"
+#include "cp0.h"
 
 #include <stdlib.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
@@ -37,6 +52,7 @@ static int cmd_c(char *args) {
 static int cmd_q(char *args) {
 	extern void close_trace();
    	close_trace();
+	timing_kanata_close();
 	return -1;
 }
 
@@ -54,15 +70,64 @@ static int cmd_si(char *args) {
 	return 0;
 }
 
+static void show_position() {
+	printf("At instruction %" PRIu64 ", pc = 0x%08x\n", nr_instr, cpu.pc);
+}
+
+static int cmd_rsi(char *args) {
+	uint64_t n = 1;
+	if (args != NULL) {
+		n = strtoull(args, NULL, 0);
+		if (n == 0) {
+			printf("Invalid argument for rsi: %s\n", args);
+			return 0;
+		}
+	}
+	if (reverse_step(n)) { show_position(); }
+	return 0;
+}
+
+static int cmd_rc(char *args) {
+	if (reverse_continue()) { show_position(); }
+	return 0;
+}
+
 static int cmd_info(char *args) {
 	if (args == NULL) {
 		printf("Usage: info <subcommand>\n");
 		printf("Subcommands: r - register status\n");
+		printf("             timing - pipeline timing model report\n");
+		printf("             cache - cache simulator report\n");
+		printf("             bpred - branch predictor report\n");
+		printf("             profile - guest function profile\n");
+		printf("             sample - estimates of the sampled simulation\n");
+		printf("             metrics - run metrics as JSON\n");
+		printf("             device - memory-mapped devices\n");
+		printf("             board - LEDs, x7seg, switches and buttons\n");
+		printf("             cp0 - coprocessor 0 registers\n");
 		return 0;
 	}
 	
 	if (strcmp(args, "r") == 0) {
 		display_reg();
+	} else if (strcmp(args, "timing") == 0) {
+		timing_report(stdout);
+	} else if (strcmp(args, "cache") == 0) {
+		cache_report(stdout);
+	} else if (strcmp(args, "bpred") == 0) {
+		bpred_report(stdout);
+	} else if (strcmp(args, "profile") == 0) {
+		profile_report(stdout);
+	} else if (strcmp(args, "sample") == 0) {
+		sample_report(stdout);
+	} else if (strcmp(args, "metrics") == 0) {
+		metrics_dump_json(stdout);
+	} else if (strcmp(args, "device") == 0) {
+		mmio_list(stdout);
+	} else if (strcmp(args, "board") == 0) {
+		board_report(stdout);
+	} else if (strcmp(args, "cp0") == 0) {
+		cp0_report(stdout);
 	} else {
 		printf("Unknown subcommand: %s\n", args);
 	}
@@ -176,6 +241,211 @@ static int cmd_d(char *args) {
     return 0;
 }
 
+static int cmd_timing(char *args) {
+	char *sub = strtok(args, " ");
+	char *arg = strtok(NULL, " ");
+
+	if(sub == NULL) {
+		timing_report(stdout);
+	} else if(strcmp(sub, "on") == 0) {
+		timing_enable(true);
+	} else if(strcmp(sub, "off") == 0) {
+		timing_enable(false);
+	} else if(strcmp(sub, "reset") == 0) {
+		timing_reset();
+	} else if(strcmp(sub, "fwd") == 0 && arg != NULL) {
+		timing_config.forwarding = (strcmp(arg, "on") == 0);
+	} else if(strcmp(sub, "branch") == 0 && arg != NULL) {
+		timing_config.branch_stage = (strcmp(arg, "ex") == 0) ? TM_EX : TM_ID;
+	} else if(strcmp(sub, "iwait") == 0 && arg != NULL) {
+		timing_config.ifetch_wait = atoi(arg);
+	} else if(strcmp(sub, "dwait") == 0 && arg != NULL) {
+		timing_config.dmem_wait = atoi(arg);
+	} else if(strcmp(sub, "mul") == 0 && arg != NULL) {
+		timing_config.mul_latency = atoi(arg);
+	} else if(strcmp(sub, "div") == 0 && arg != NULL) {
+		timing_config.div_latency = atoi(arg);
+	} else if(strcmp(sub, "kanata") == 0 && arg != NULL) {
+		char *start = strtok(NULL, " ");
+		char *count = strtok(NULL, " ");
+		if(!timing_kanata(arg, start ? strtoull(start, NULL, 0) : 0, count ? strtoull(count, NULL, 0) : 1000)) {
+			printf("Can not open '%s'\n", arg);
+		}
+	} else {
+		printf("Usage: timing [on|off|reset]\n");
+		printf("       timing fwd on|off       - forwarding network\n");
+		printf("       timing branch id|ex     - stage resolving branches\n");
+		printf("       timing iwait|dwait N    - instruction/data memory wait states\n");
+		printf("       timing mul|div N        - multiply/divide latency\n");
+		printf("       timing kanata FILE [START [COUNT]] - export stage timestamps\n");
+	}
+	return 0;
+}
+
+static int cmd_cache(char *args) {
+	char *which = strtok(args, " ");
+	char *arg = strtok(NULL, " ");
+	int w;
+
+	if(which == NULL) {
+		cache_report(stdout);
+		return 0;
+	}
+
+	if(strcmp(which, "i") == 0 && arg != NULL) { w = ICACHE; }
+	else if(strcmp(which, "d") == 0 && arg != NULL) { w = DCACHE; }
+	else {
+		printf("Usage: cache i|d SIZE ASSOC LINE [lru|plru|random] [wb|wt]\n");
+		printf("       cache i|d off\n");
+		return 0;
+	}
+
+	if(strcmp(arg, "off") == 0) {
+		cache_disable(w);
+		return 0;
+	}
+
+	CacheConfig cfg = { .size = strtoul(arg, NULL, 0), .assoc = 1, .line_size = 16,
+		.repl = REPL_LRU, .write_back = true };
+	char *tok;
+	if((tok = strtok(NULL, " ")) != NULL) { cfg.assoc = strtoul(tok, NULL, 0); }
+	if((tok = strtok(NULL, " ")) != NULL) { cfg.line_size = strtoul(tok, NULL, 0); }
+	while((tok = strtok(NULL, " ")) != NULL) {
+		if(strcmp(tok, "lru") == 0) { cfg.repl = REPL_LRU; }
+		else if(strcmp(tok, "plru") == 0) { cfg.repl = REPL_PLRU; }
+		else if(strcmp(tok, "random") == 0) { cfg.repl = REPL_RANDOM; }
+		else if(strcmp(tok, "wb") == 0) { cfg.write_back = true; }
+		else if(strcmp(tok, "wt") == 0) { cfg.write_back = false; }
+		else { printf("Unknown cache option '%s'\n", tok); return 0; }
+	}
+
+	if(!cache_enable(w, &cfg)) {
+		printf("Invalid cache geometry: sizes must be powers of 2, at most 32 ways\n");
+	}
+	return 0;
+}
+
+static int cmd_bpred(char *args) {
+	char *name = strtok(args, " ");
+	char *arg = strtok(NULL, " ");
+	int kind;
+
+	if(name == NULL) {
+		bpred_report(stdout);
+		return 0;
+	}
+
+	if(strcmp(name, "off") == 0) {
+		for(kind = 0; kind < NR_BP; kind ++) { bpred_disable(kind); }
+		return 0;
+	}
+
+	if(strcmp(name, "all") == 0) {
+		for(kind = 0; kind < NR_BP; kind ++) { bpred_enable(kind, arg ? atoi(arg) : 0); }
+		return 0;
+	}
+
+	kind = bpred_find(name);
+	if(kind < 0) {
+		printf("Usage: bpred [nt|btfn|bimodal|gshare|btb|all] [LOG2_ENTRIES|off]\n");
+		printf("       bpred off\n");
+		return 0;
+	}
+
+	if(arg != NULL && strcmp(arg, "off") == 0) {
+		bpred_disable(kind);
+	} else if(!bpred_enable(kind, arg ? atoi(arg) : 0)) {
+		printf("Invalid predictor size: %s\n", arg);
+	}
+	return 0;
+}
+
+static int cmd_profile(char *args) {
+	char *sub = strtok(args, " ");
+	char *arg = strtok(NULL, " ");
+
+	if(sub == NULL) {
+		profile_report(stdout);
+	} else if(strcmp(sub, "on") == 0) {
+		if(!profile_enable(arg)) { printf("Can not read the symbols of '%s'\n", arg); }
+	} else if(strcmp(sub, "off") == 0) {
+		profile_disable();
+	} else if(strcmp(sub, "callgrind") == 0 && arg != NULL) {
+		if(!profile_write_callgrind(arg)) { printf("Can not write '%s', is the profiler on?\n", arg); }
+	} else {
+		printf("Usage: profile [on [ELF]|off]\n");
+		printf("       profile callgrind FILE - write the call graph for kcachegrind\n");
+	}
+	return 0;
+}
+
+static int cmd_mode(char *args) {
+	char *name = strtok(args, " ");
+	char *trigger = strtok(NULL, " ");
+	char *arg = strtok(NULL, " ");
+	bool fast;
+
+	if(name == NULL) {
+		mode_report(stdout);
+		return 0;
+	}
+
+	if(strcmp(name, "fast") == 0 || strcmp(name, "detail") == 0) {
+		fast = strcmp(name, "fast") == 0;
+		if(trigger == NULL) {
+			mode_set(fast);
+			mode_report(stdout);
+			return 0;
+		}
+		if(strcmp(trigger, "pc") == 0 && arg != NULL) {
+			mode_at_pc(strtoul(arg, NULL, 0), fast);
+			return 0;
+		}
+		if(strcmp(trigger, "instr") == 0 && arg != NULL) {
+			mode_at_instr(strtoull(arg, NULL, 0), fast);
+			return 0;
+		}
+	}
+
+	printf("Usage: mode [fast|detail] - switch to the fast-forward or the detailed mode\n");
+	printf("       mode fast|detail pc ADDR - switch when $pc reaches ADDR\n");
+	printf("       mode fast|detail instr N - switch after instruction N\n");
+	return 0;
+}
+
+static int cmd_board(char *args) {
+	char *name = strtok(args, " ");
+	char *arg = strtok(NULL, " ");
+	int reg;
+
+	if(name == NULL) {
+		board_report(stdout);
+	} else if(strcmp(name, "log") == 0 && arg != NULL) {
+		if(strcmp(arg, "off") == 0) { board_log_close(); }
+		else if(!board_log_open(arg)) { printf("Can not open '%s'\n", arg); }
+	} else if((reg = board_find(name)) >= 0 && arg != NULL) {
+		if(!board_set_input(reg, strtoul(arg, NULL, 0))) {
+			printf("'%s' is an output of the guest\n", name);
+		}
+	} else {
+		printf("Usage: board sw_1|sw_2|btn VALUE\n");
+		printf("       board log FILE|off\n");
+	}
+	return 0;
+}
+
+static int cmd_zone(char *args) {
+	if(args == NULL) {
+		printf("Usage: zone FILE|off\n");
+		printf("Zone tracing is %s.\n", zone_enabled ? "on" : "off");
+	} else if(strcmp(args, "off") == 0) {
+		zone_close();
+	} else if(!zone_open(args)) {
+		printf("Can not open '%s'\n", args);
+	}
+	return 0;
+}
+
 static int cmd_help(char *args);
 
 static struct {
@@ -187,10 +457,19 @@ static struct {
 	{ "c", "Continue the execution of the program", cmd_c },
 	{ "q", "Exit TEMU", cmd_q },
 	{ "si", "Step one instruction exactly", cmd_si },
+	{ "rsi", "Step back N instructions", cmd_rsi },
+	{ "rc", "Continue backwards to the previous change of a watchpoint", cmd_rc },
 	{ "info", "Print program status", cmd_info },
 	{ "x", "Scan memory", cmd_x },
 	{ "w", "Set watchpoint", cmd_w },
-	{ "d", "Delete watchpoint", cmd_d }
+	{ "d", "Delete watchpoint", cmd_d },
+	{ "timing", "Configure the pipeline timing model", cmd_timing },
+	{ "cache", "Configure the I-cache/D-cache simulator", cmd_cache },
+	{ "bpred", "Configure the branch predictor simulator", cmd_bpred },
+	{ "profile", "Profile the guest functions with a shadow call stack", cmd_profile },
+	{ "mode", "Switch between the fast-forward and the detailed mode", cmd_mode },
+	{ "zone", "Write emulator phases as Chrome trace events", cmd_zone },
+	{ "board", "Show the board I/O, set switches and buttons", cmd_board }
 };
 
 #define NR_CMD (sizeof(cmd_table) / sizeof(cmd_table[0]))
@@ -218,32 +497,83 @@ static int cmd_help(char *args) {
 	return 0;
 }
 
+/* Run one command line, return -1 if it quits. */
+static int run_command(char *str) {
+	char *str_end = str + strlen(str);
+
+	/* extract the first token as the command */
+	char *cmd = strtok(str, " \t");
+	if(cmd == NULL) { return 0; }
+
+	/* treat the remaining string as the arguments,
+	 * which may need further parsing
+	 */
+	char *args = cmd + strlen(cmd) + 1;
+	if(args >= str_end) {
+		args = NULL;
+	}
+
+	int i;
+	for(i = 0; i < NR_CMD; i ++) {
+		if(strcmp(cmd, cmd_table[i].name) == 0) {
+			return cmd_table[i].handler(args) < 0 ? -1 : 0;
+		}
+	}
+
+	printf("Unknown command '%s'\n", cmd);
+	return 0;
+}
+
 void ui_mainloop() {
 	while(1) {
 		char *str = rl_gets();
-		char *str_end = str + strlen(str);
-
-		/* extract the first token as the command */
-		char *cmd = strtok(str, " ");
-		if(cmd == NULL) { continue; }
-
-		/* treat the remaining string as the arguments,
-		 * which may need further parsing
-		 */
-		char *args = cmd + strlen(cmd) + 1;
-		if(args >= str_end) {
-			args = NULL;
-		}
 
-		int i;
-		for(i = 0; i < NR_CMD; i ++) {
-			if(strcmp(cmd, cmd_table[i].name) == 0) {
-				if(cmd_table[i].handler(args) < 0) { return; }
-				break;
-			}
+		/* end of the input */
+		if(str == NULL) {
+			cmd_q(NULL);
+			return;
 		}
-
-		if(i == NR_CMD) { printf("Unknown command '%s'\n", cmd); }
+		if(run_command(str) < 0) { return; }
 	}
 }
 
+static void timeout_handler(int sig) {
+	timed_out = 1;
+}
+
+void ui_set_timeout(unsigned seconds) {
+	signal(SIGALRM, timeout_handler);
+	alarm(seconds);
+}
+
+bool ui_timed_out() {
+	return timed_out;
+}
+
+int ui_exit_code() {
+	if(timed_out) { return EXIT_TIMEOUT; }
+	return temu_state == END ? guest_exit_code : EXIT_NOT_ENDED;
+}
+
+/* Run the commands in `script', separated by newlines or `;', without
+ * readline. A `#' starts a comment. The run quits at the end of the
+ * script or after a timeout.
+ */
+void ui_run_script(const char *script) {
+	char *buf = strdup(script), *line, *next;
+
+	for(line = buf; line != NULL && !timed_out; line = next) {
+		next = strpbrk(line, ";\n");
+		if(next != NULL) { *next ++ = '\0'; }
+
+		char *comment = strchr(line, '#');
+		if(comment != NULL) { *comment = '\0'; }
+
+		if(run_command(line) < 0) {
+			free(buf);
+			return;
+		}
+	}
+	free(buf);
+	cmd_q(NULL);
+}
@@ -1,5 +1,7 @@
 #include "watchpoint.h"
 #include "expr.h"
+#include "perf/zone.h"
+#include "perf/metrics.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -8,6 +10,10 @@
 
 static WP wp_pool[NR_WP];
 static WP *head, *free_;
+static int mode = WP_ON;
+static uint64_t nr_hit = 0;
+
+static Metric m_wp_evals = { .name = "watchpoint.evaluations", .unit = "evaluations", .type = METRIC_COUNTER };
 
 void init_wp_pool() {
 	int i;
@@ -19,6 +25,8 @@ void init_wp_pool() {
 
 	head = NULL;
 	free_ = wp_pool;
+
+	metric_register(&m_wp_evals);
 }
 
 /* TODO: Implement the functionality of watchpoint */
@@ -73,30 +81,58 @@ WP* find_wp(int NO) {
 }
 
 /* 检查所有监视点，返回是否有值变化 */
+bool wp_active() {
+    return head != NULL && mode != WP_OFF;
+}
+
+void wp_set_mode(int m) {
+    mode = m;
+}
+
+uint64_t wp_hits() {
+    return nr_hit;
+}
+
+void wp_rebase() {
+    WP *wp;
+    for(wp = head; wp != NULL; wp = wp->next) {
+        bool success;
+        uint32_t val = expr(wp->expr, &success);
+        if(success) { wp->old_value = val; }
+    }
+}
+
 bool check_wp() {
+    ZONE("check_wp");
     bool changed = false;
     WP *wp = head;
+
+    if(mode == WP_OFF) { return false; }
     
     while(wp != NULL) {
         bool success;
         uint32_t new_val = expr(wp->expr, &success);
+        m_wp_evals.count ++;
         
         if(success) {
             if(wp->old_value != new_val) {
-                printf("Watchpoint %d: %s\n", wp->NO, wp->expr);
-                printf("Old value = 0x%08x (%u)\n", wp->old_value, wp->old_value);
-                printf("New value = 0x%08x (%u)\n", new_val, new_val);
+                if(mode == WP_ON) {
+                    printf("Watchpoint %d: %s\n", wp->NO, wp->expr);
+                    printf("Old value = 0x%08x (%u)\n", wp->old_value, wp->old_value);
+                    printf("New value = 0x%08x (%u)\n", new_val, new_val);
+                }
                 wp->old_value = new_val;
                 changed = true;
             }
-        } else {
+        } else if(mode == WP_ON) {
             printf("Warning: Cannot evaluate expression '%s' for watchpoint %d\n", 
                    wp->expr, wp->NO);
         }
         
         wp = wp->next;
     }
-    
+
+    if(changed) { nr_hit ++; }
     return changed;
 }
 
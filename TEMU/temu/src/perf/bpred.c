@@ -0,0 +1,193 @@
+#include "perf/bpred.h"
+#include "perf/observer.h"
+#include "perf/pchist.h"
+#include "monitor/monitor.h"
+#include "monitor/mode.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* Branch predictor models observing the conditional branches of the guest.
+ * They only count how often they would have been wrong, the guest does
+ * not execute speculatively.
+ */
+
+#define NR_TOP_MISS_PC 10
+#define DEFAULT_LOG_SIZE 10
+
+typedef struct {
+	uint32_t pc, target;
+	bool valid;
+} BTBEntry;
+
+typedef struct {
+	const char *name;
+	const char *description;
+	bool enabled;
+	int log_size;
+	uint8_t *counters;	/* 2-bit saturating counters of bimodal/gshare */
+	BTBEntry *btb;
+	uint32_t ghr;		/* global history of gshare */
+
+	uint64_t branches, taken, mispredicts;
+	uint64_t instr_base, fast_base;	/* nr_instr and the fast-forwarded part when enabled */
+	PCHist miss_pc;
+} Predictor;
+
+static Predictor predictors[NR_BP] = {
+	[BP_NOT_TAKEN] = { "nt", "static not-taken" },
+	[BP_BTFN] = { "btfn", "backward taken, forward not-taken" },
+	[BP_BIMODAL] = { "bimodal", "bimodal 2-bit counters" },
+	[BP_GSHARE] = { "gshare", "gshare" },
+	[BP_BTB] = { "btb", "direct-mapped BTB, predict taken on hit" },
+};
+
+static int nr_enabled;
+
+static inline uint32_t table_index(Predictor *p, uint32_t pc) {
+	return (pc >> 2) & ((1u << p->log_size) - 1);
+}
+
+/* Predict the branch at `pc', train the predictor with the actual outcome
+ * and return whether the prediction was right.
+ */
+static bool predict_and_update(Predictor *p, uint32_t pc, uint32_t target, bool taken) {
+	bool pred;
+	uint32_t idx;
+
+	switch(p - predictors) {
+		case BP_NOT_TAKEN:
+			return !taken;
+
+		case BP_BTFN:
+			return (target < pc) == taken;
+
+		case BP_BIMODAL:
+			idx = table_index(p, pc);
+			pred = p->counters[idx] >= 2;
+			if(taken) { if(p->counters[idx] < 3) { p->counters[idx] ++; } }
+			else { if(p->counters[idx] > 0) { p->counters[idx] --; } }
+			return pred == taken;
+
+		case BP_GSHARE:
+			idx = (table_index(p, pc) ^ p->ghr) & ((1u << p->log_size) - 1);
+			pred = p->counters[idx] >= 2;
+			if(taken) { if(p->counters[idx] < 3) { p->counters[idx] ++; } }
+			else { if(p->counters[idx] > 0) { p->counters[idx] --; } }
+			p->ghr = (p->ghr << 1) | taken;
+			return pred == taken;
+
+		case BP_BTB: {
+			BTBEntry *e = &p->btb[table_index(p, pc)];
+			bool hit = e->valid && e->pc == pc;
+			bool right = taken ? (hit && e->target == target) : !hit;
+			if(taken) {
+				e->valid = true;
+				e->pc = pc;
+				e->target = target;
+			}
+			else if(hit) {
+				e->valid = false;
+			}
+			return right;
+		}
+	}
+	return false;
+}
+
+static void bpred_branch(uint32_t pc, uint32_t target, bool taken) {
+	int i;
+	for(i = 0; i < NR_BP; i ++) {
+		Predictor *p = &predictors[i];
+		if(!p->enabled) { continue; }
+
+		p->branches ++;
+		p->taken += taken;
+		if(!predict_and_update(p, pc, target, taken)) {
+			p->mispredicts ++;
+			pchist_add(&p->miss_pc, pc);
+		}
+	}
+}
+
+static Observer bpred_observer = { .name = "bpred", .branch = bpred_branch };
+
+int bpred_find(const char *name) {
+	int i;
+	for(i = 0; i < NR_BP; i ++) {
+		if(strcmp(name, predictors[i].name) == 0) { return i; }
+	}
+	return -1;
+}
+
+bool bpred_enable(int kind, int log_size) {
+	Predictor *p = &predictors[kind];
+	if(log_size <= 0) { log_size = DEFAULT_LOG_SIZE; }
+	if(log_size > 24) { return false; }
+
+	bpred_disable(kind);
+
+	p->log_size = log_size;
+	if(kind == BP_BIMODAL || kind == BP_GSHARE) {
+		p->counters = malloc(1u << log_size);
+		Assert(p->counters, "Can not allocate the %s predictor", p->name);
+		memset(p->counters, 1, 1u << log_size);	/* weakly not-taken */
+	}
+	else if(kind == BP_BTB) {
+		p->btb = calloc(1u << log_size, sizeof(BTBEntry));
+		Assert(p->btb, "Can not allocate the %s predictor", p->name);
+	}
+	p->ghr = 0;
+	p->branches = p->taken = p->mispredicts = 0;
+	p->instr_base = nr_instr;
+	p->fast_base = mode_fast_instructions();
+	pchist_reset(&p->miss_pc);
+
+	if(nr_enabled ++ == 0) {
+		register_observer(&bpred_observer);
+	}
+	p->enabled = true;
+	return true;
+}
+
+void bpred_disable(int kind) {
+	Predictor *p = &predictors[kind];
+	if(!p->enabled) { return; }
+
+	free(p->counters);
+	free(p->btb);
+	p->counters = NULL;
+	p->btb = NULL;
+	p->enabled = false;
+
+	if(-- nr_enabled == 0) {
+		unregister_observer(&bpred_observer);
+	}
+}
+
+void bpred_report(FILE *fp) {
+	int i;
+	if(nr_enabled == 0) {
+		fprintf(fp, "No branch predictor enabled.\n");
+		return;
+	}
+
+	for(i = 0; i < NR_BP; i ++) {
+		Predictor *p = &predictors[i];
+		if(!p->enabled) { continue; }
+
+		/* the instructions the predictor saw, i.e. not fast-forwarded */
+		uint64_t instrs = nr_instr - p->instr_base - (mode_fast_instructions() - p->fast_base);
+		if(nr_instr < p->instr_base) { instrs = 0; }	/* the machine was reset */
+
+		fprintf(fp, "%s (%s", p->name, p->description);
+		if(p->counters || p->btb) { fprintf(fp, ", %u entries", 1u << p->log_size); }
+		fprintf(fp, ")\n");
+		fprintf(fp, "  branches %" PRIu64 " (taken %" PRIu64 "), mispredicted %" PRIu64 "\n",
+				p->branches, p->taken, p->mispredicts);
+		fprintf(fp, "  accuracy %.2f%%, MPKI %.3f\n",
+				p->branches ? 100.0 * (p->branches - p->mispredicts) / p->branches : 100.0,
+				instrs ? 1000.0 * p->mispredicts / instrs : 0.0);
+		pchist_print_top(&p->miss_pc, fp, NR_TOP_MISS_PC, "mispredicted pc");
+	}
+}
@@ -0,0 +1,224 @@
+#include "perf/cache.h"
+#include "perf/observer.h"
+#include "perf/pchist.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* A trace-driven cache simulator. It only keeps tags, the data always
+ * comes from the memory, so the guest behaves exactly as without caches.
+ */
+
+#define NR_TOP_MISS_PC 10
+
+typedef struct {
+	uint32_t tag;
+	bool valid, dirty;
+	uint64_t stamp;		/* last use, for LRU */
+} CacheLine;
+
+typedef struct {
+	const char *name;
+	bool enabled;
+	CacheConfig cfg;
+	uint32_t nr_set;
+	int offset_bits, index_bits;
+	CacheLine *lines;	/* nr_set * assoc */
+	uint64_t *plru;		/* tree bits of every set */
+	uint64_t clock;
+
+	uint64_t reads, writes, read_misses, write_misses;
+	uint64_t writebacks, write_throughs;
+	PCHist miss_pc;
+} Cache;
+
+static Cache caches[NR_CACHE] = {
+	[ICACHE] = { .name = "I-cache" },
+	[DCACHE] = { .name = "D-cache" },
+};
+
+static const char *repl_name[] = { "LRU", "PLRU", "random" };
+
+static uint32_t rand_state = 0x12345678;
+
+static uint32_t xorshift32() {
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static int log2_exact(uint32_t x) {
+	int n = 0;
+	if(x == 0 || (x & (x - 1)) != 0) { return -1; }
+	while((1u << n) != x) { n ++; }
+	return n;
+}
+
+/* Tree-PLRU: the bits of a set form a binary tree, a bit set to 1 means
+ * the left half was used more recently, so the victim is on the right.
+ */
+static void plru_touch(Cache *c, uint32_t set, uint32_t way) {
+	uint64_t *bits = &c->plru[set];
+	uint32_t node = 1, lo = 0, hi = c->cfg.assoc;
+	while(hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+		if(way < mid) { *bits |= (1ull << node); node = node * 2; hi = mid; }
+		else { *bits &= ~(1ull << node); node = node * 2 + 1; lo = mid; }
+	}
+}
+
+static uint32_t plru_victim(Cache *c, uint32_t set) {
+	uint64_t bits = c->plru[set];
+	uint32_t node = 1, lo = 0, hi = c->cfg.assoc;
+	while(hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+		if(bits & (1ull << node)) { node = node * 2 + 1; lo = mid; }
+		else { node = node * 2; hi = mid; }
+	}
+	return lo;
+}
+
+static uint32_t choose_victim(Cache *c, uint32_t set, CacheLine *ways) {
+	uint32_t i, victim = 0;
+	for(i = 0; i < c->cfg.assoc; i ++) {
+		if(!ways[i].valid) { return i; }
+	}
+
+	switch(c->cfg.repl) {
+		case REPL_PLRU:
+			return plru_victim(c, set);
+		case REPL_RANDOM:
+			return xorshift32() % c->cfg.assoc;
+		default:
+			for(i = 1; i < c->cfg.assoc; i ++) {
+				if(ways[i].stamp < ways[victim].stamp) { victim = i; }
+			}
+			return victim;
+	}
+}
+
+static void cache_access(Cache *c, uint32_t pc, uint32_t addr, bool is_write) {
+	uint32_t set = (addr >> c->offset_bits) & (c->nr_set - 1);
+	uint32_t tag = addr >> (c->offset_bits + c->index_bits);
+	CacheLine *ways = &c->lines[set * c->cfg.assoc];
+	uint32_t i;
+
+	c->clock ++;
+	if(is_write) { c->writes ++; } else { c->reads ++; }
+
+	for(i = 0; i < c->cfg.assoc; i ++) {
+		if(ways[i].valid && ways[i].tag == tag) {
+			/* hit */
+			ways[i].stamp = c->clock;
+			if(c->cfg.repl == REPL_PLRU) { plru_touch(c, set, i); }
+			if(is_write) {
+				if(c->cfg.write_back) { ways[i].dirty = true; }
+				else { c->write_throughs ++; }
+			}
+			return;
+		}
+	}
+
+	/* miss */
+	if(is_write) { c->write_misses ++; } else { c->read_misses ++; }
+	pchist_add(&c->miss_pc, pc);
+
+	if(is_write && !c->cfg.write_back) {
+		/* no-write-allocate */
+		c->write_throughs ++;
+		return;
+	}
+
+	i = choose_victim(c, set, ways);
+	if(ways[i].valid && ways[i].dirty) { c->writebacks ++; }
+	ways[i].valid = true;
+	ways[i].dirty = is_write;
+	ways[i].tag = tag;
+	ways[i].stamp = c->clock;
+	if(c->cfg.repl == REPL_PLRU) { plru_touch(c, set, i); }
+}
+
+static void icache_fetch(uint32_t pc) {
+	cache_access(&caches[ICACHE], pc, pc, false);
+}
+
+static void dcache_mem(uint32_t pc, uint32_t addr, size_t len, bool is_write) {
+	cache_access(&caches[DCACHE], pc, addr, is_write);
+}
+
+static Observer cache_observers[NR_CACHE] = {
+	[ICACHE] = { .name = "icache", .fetch = icache_fetch },
+	[DCACHE] = { .name = "dcache", .mem = dcache_mem },
+};
+
+bool cache_enable(int which, const CacheConfig *cfg) {
+	Cache *c = &caches[which];
+	int line_bits = log2_exact(cfg->line_size);
+	int assoc_bits = log2_exact(cfg->assoc);
+
+	if(line_bits < 2 || assoc_bits < 0 || cfg->assoc > 32 ||
+			cfg->size < cfg->line_size * cfg->assoc || log2_exact(cfg->size) < 0) {
+		return false;
+	}
+
+	cache_disable(which);
+
+	c->cfg = *cfg;
+	c->nr_set = cfg->size / cfg->line_size / cfg->assoc;
+	c->offset_bits = line_bits;
+	c->index_bits = log2_exact(c->nr_set);
+	c->lines = calloc(c->nr_set * cfg->assoc, sizeof(CacheLine));
+	c->plru = calloc(c->nr_set, sizeof(uint64_t));
+	Assert(c->lines && c->plru, "Can not allocate the %s", c->name);
+
+	c->clock = 0;
+	c->reads = c->writes = c->read_misses = c->write_misses = 0;
+	c->writebacks = c->write_throughs = 0;
+	pchist_reset(&c->miss_pc);
+
+	c->enabled = true;
+	register_observer(&cache_observers[which]);
+	return true;
+}
+
+void cache_disable(int which) {
+	Cache *c = &caches[which];
+	if(!c->enabled) { return; }
+
+	unregister_observer(&cache_observers[which]);
+	free(c->lines);
+	free(c->plru);
+	c->lines = NULL;
+	c->plru = NULL;
+	c->enabled = false;
+}
+
+void cache_report(FILE *fp) {
+	int w;
+	for(w = 0; w < NR_CACHE; w ++) {
+		Cache *c = &caches[w];
+		if(!c->enabled) {
+			fprintf(fp, "%s: off\n", c->name);
+			continue;
+		}
+
+		uint64_t accesses = c->reads + c->writes;
+		uint64_t misses = c->read_misses + c->write_misses;
+		fprintf(fp, "%s: %u bytes, %u-way, %u-byte lines, %s, %s\n", c->name,
+				c->cfg.size, c->cfg.assoc, c->cfg.line_size, repl_name[c->cfg.repl],
+				c->cfg.write_back ? "write-back" : "write-through");
+		fprintf(fp, "  accesses %" PRIu64 " (reads %" PRIu64 ", writes %" PRIu64 ")\n",
+				accesses, c->reads, c->writes);
+		fprintf(fp, "  hits     %" PRIu64 " (%.2f%%)\n", accesses - misses,
+				accesses ? 100.0 * (accesses - misses) / accesses : 0.0);
+		fprintf(fp, "  misses   %" PRIu64 " (%.2f%%, read %" PRIu64 ", write %" PRIu64 ")\n", misses,
+				accesses ? 100.0 * misses / accesses : 0.0, c->read_misses, c->write_misses);
+		if(w == DCACHE) {
+			fprintf(fp, "  writebacks %" PRIu64 ", write-throughs %" PRIu64 "\n",
+					c->writebacks, c->write_throughs);
+		}
+
+		pchist_print_top(&c->miss_pc, fp, NR_TOP_MISS_PC, "miss pc");
+	}
+}
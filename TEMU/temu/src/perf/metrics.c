@@ -0,0 +1,78 @@
+#include "perf/metrics.h"
+
+#include <inttypes.h>
+
+static Metric *metrics = NULL, **metrics_tail = &metrics;
+
+void metric_register(Metric *m) {
+	Metric *p;
+	for(p = metrics; p != NULL; p = p->next) {
+		if(p == m) { return; }
+		Assert(strcmp(p->name, m->name) != 0, "metric '%s' registered twice", m->name);
+	}
+
+	/* keep the registration order, so that the dump is stable */
+	m->next = NULL;
+	*metrics_tail = m;
+	metrics_tail = &m->next;
+}
+
+void metric_observe(Metric *m, uint64_t v) {
+	int b = 0;
+	while(b < NR_METRIC_BUCKET - 1 && v >= (1ull << b)) { b ++; }
+	m->bucket[b] ++;
+	m->nr_sample ++;
+	m->sum += v;
+}
+
+uint64_t metric_counter_value(const Metric *m) {
+	return m->ptr ? *m->ptr : m->count;
+}
+
+double metric_gauge_value(const Metric *m) {
+	return m->read ? m->read() : m->value;
+}
+
+Metric *metrics_first() {
+	return metrics;
+}
+
+void metrics_dump_json(FILE *fp) {
+	Metric *m;
+	int b;
+
+	fprintf(fp, "{\n  \"schema\": \"temu-metrics-1\",\n  \"metrics\": {");
+	for(m = metrics; m != NULL; m = m->next) {
+		fprintf(fp, "%s\n    \"%s\": {\"unit\": \"%s\", ", m == metrics ? "" : ",", m->name, m->unit);
+		switch(m->type) {
+			case METRIC_COUNTER:
+				fprintf(fp, "\"type\": \"counter\", \"value\": %" PRIu64 "}", metric_counter_value(m));
+				break;
+			case METRIC_GAUGE:
+				fprintf(fp, "\"type\": \"gauge\", \"value\": %.12g}", metric_gauge_value(m));
+				break;
+			case METRIC_HISTOGRAM:
+				fprintf(fp, "\"type\": \"histogram\", \"count\": %" PRIu64 ", \"sum\": %" PRIu64 ", \"buckets\": {",
+						m->nr_sample, m->sum);
+				bool first = true;
+				for(b = 0; b < NR_METRIC_BUCKET; b ++) {
+					if(m->bucket[b] == 0) { continue; }
+					/* keyed by the exclusive upper bound of the bucket */
+					fprintf(fp, "%s\"%" PRIu64 "\": %" PRIu64, first ? "" : ", ",
+							b == NR_METRIC_BUCKET - 1 ? UINT64_MAX : (uint64_t)1 << b, m->bucket[b]);
+					first = false;
+				}
+				fprintf(fp, "}}");
+				break;
+		}
+	}
+	fprintf(fp, "\n  }\n}\n");
+}
+
+bool metrics_write(const char *filename) {
+	FILE *fp = fopen(filename, "w");
+	if(fp == NULL) { return false; }
+	metrics_dump_json(fp);
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,54 @@
+#include "perf/observer.h"
+
+Observer *observers = NULL;
+
+/* the list while the observers are suspended */
+static Observer *suspended = NULL;
+static bool is_suspended = false;
+
+static Observer **list() {
+	return is_suspended ? &suspended : &observers;
+}
+
+void register_observer(Observer *obs) {
+	Observer *o;
+	for(o = *list(); o != NULL; o = o->next) {
+		if(o == obs) { return; }
+	}
+
+	obs->next = *list();
+	*list() = obs;
+}
+
+void unregister_observer(Observer *obs) {
+	Observer **p;
+	for(p = list(); *p != NULL; p = &(*p)->next) {
+		if(*p == obs) {
+			*p = obs->next;
+			obs->next = NULL;
+			return;
+		}
+	}
+}
+
+bool observers_see_instr() {
+	Observer *o;
+	for(o = observers; o != NULL; o = o->next) {
+		if(o->fetch || o->mem || o->branch || o->retire) { return true; }
+	}
+	return false;
+}
+
+void observers_suspend() {
+	if(is_suspended) { return; }
+	suspended = observers;
+	observers = NULL;
+	is_suspended = true;
+}
+
+void observers_resume() {
+	if(!is_suspended) { return; }
+	observers = suspended;
+	suspended = NULL;
+	is_suspended = false;
+}
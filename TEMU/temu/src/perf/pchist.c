@@ -0,0 +1,44 @@
+#include "perf/pchist.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+void pchist_reset(PCHist *h) {
+	memset(h, 0, sizeof(*h));
+}
+
+void pchist_add(PCHist *h, uint32_t pc) {
+	uint32_t hash = (pc >> 2) * 2654435761u;
+	int i;
+	for(i = 0; i < NR_PCHIST; i ++) {
+		PCCount *e = &h->entry[(hash + i) & (NR_PCHIST - 1)];
+		if(e->count == 0) { e->pc = pc; }
+		if(e->pc == pc) {
+			e->count ++;
+			return;
+		}
+	}
+	h->dropped ++;
+}
+
+static int pchist_cmp(const void *a, const void *b) {
+	const PCCount *x = a, *y = b;
+	if(x->count != y->count) { return x->count > y->count ? -1 : 1; }
+	return x->pc < y->pc ? -1 : (x->pc > y->pc);
+}
+
+void pchist_print_top(PCHist *h, FILE *fp, int n, const char *label) {
+	PCHist *top = malloc(sizeof(PCHist));
+	Assert(top, "Can not allocate the pc histogram");
+	memcpy(top, h, sizeof(PCHist));
+	qsort(top->entry, NR_PCHIST, sizeof(PCCount), pchist_cmp);
+
+	int i;
+	for(i = 0; i < n && i < NR_PCHIST && top->entry[i].count > 0; i ++) {
+		fprintf(fp, "  %s 0x%08x  %" PRIu64 "\n", label, top->entry[i].pc, top->entry[i].count);
+	}
+	if(h->dropped) {
+		fprintf(fp, "  (%" PRIu64 " more from untracked pcs)\n", h->dropped);
+	}
+	free(top);
+}
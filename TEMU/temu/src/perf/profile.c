@@ -0,0 +1,468 @@
+#include "perf/profile.h"
+#include "perf/observer.h"
+#include "perf/metrics.h"
+#include "monitor/monitor.h"
+#include "temu.h"
+
+#include <elf.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#define NR_TOP_FUNC 20
+
+/* a return skips at most this many frames, e.g. after a longjmp() */
+#define MAX_UNWIND 16
+
+typedef struct {
+	char *name;
+	uint32_t addr, end;
+	bool is_func;		/* STT_FUNC, preferred to a label at the same address */
+	uint64_t self, inclusive, calls;
+	int active;		/* frames on the shadow stack */
+} Func;
+
+typedef struct {
+	int caller, callee;
+	uint64_t calls, inclusive;
+} Edge;
+
+typedef struct {
+	int func, edge;
+	uint32_t ret_addr;
+	uint64_t entry;		/* nr_instr when the inclusive cost was charged last */
+} Frame;
+
+/* open addressing from a 64-bit key to an index */
+typedef struct {
+	uint64_t *keys;
+	int *vals;
+	uint32_t mask;
+	int n;
+} Map;
+
+static bool enabled = false;
+
+/* funcs[0] is "[unknown]", then the symbols sorted by address, then the
+ * call targets outside of any symbol
+ */
+static Func *funcs;
+static int nr_func, nr_sym, max_func;
+static Edge *edges;
+static int nr_edge, max_edge;
+static Map entry_map, edge_map;
+
+static Frame *stack;
+static int depth, max_depth;
+static uint64_t mark;		/* nr_instr when the self cost was charged last */
+
+static Metric m_calls = { .name = "profile.calls", .unit = "calls", .type = METRIC_COUNTER };
+
+static void map_init(Map *m, uint32_t size) {
+	m->keys = malloc(size * sizeof(uint64_t));
+	m->vals = malloc(size * sizeof(int));
+	Assert(m->keys && m->vals, "Can not allocate the profiler");
+	memset(m->vals, -1, size * sizeof(int));
+	m->mask = size - 1;
+	m->n = 0;
+}
+
+static void map_free(Map *m) {
+	free(m->keys);
+	free(m->vals);
+	m->keys = NULL;
+	m->vals = NULL;
+}
+
+static int *map_slot(Map *m, uint64_t key) {
+	uint32_t i = (uint32_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & m->mask;
+	while(m->vals[i] >= 0 && m->keys[i] != key) { i = (i + 1) & m->mask; }
+	m->keys[i] = key;
+	return &m->vals[i];
+}
+
+/* The index of `key', or -1 after which the caller stores the new index
+ * in the returned slot.
+ */
+static int *map_find(Map *m, uint64_t key) {
+	int *v = map_slot(m, key);
+	if(*v < 0 && (m->n + 1) * 2 > m->mask + 1) {
+		Map old = *m;
+		uint32_t i;
+		map_init(m, (old.mask + 1) * 2);
+		for(i = 0; i <= old.mask; i ++) {
+			if(old.vals[i] >= 0) {
+				*map_slot(m, old.keys[i]) = old.vals[i];
+				m->n ++;
+			}
+		}
+		map_free(&old);
+		v = map_slot(m, key);
+	}
+	if(*v < 0) { m->n ++; }
+	return v;
+}
+
+static int new_func(const char *name, uint32_t addr, uint32_t end, bool is_func) {
+	Func *f;
+	if(nr_func == max_func) {
+		max_func = max_func ? max_func * 2 : 256;
+		funcs = realloc(funcs, max_func * sizeof(Func));
+		Assert(funcs, "Can not allocate the profiler");
+	}
+	f = &funcs[nr_func];
+	memset(f, 0, sizeof(*f));
+	f->name = strdup(name);
+	f->addr = addr;
+	f->end = end;
+	f->is_func = is_func;
+	return nr_func ++;
+}
+
+static int func_cmp(const void *a, const void *b) {
+	const Func *x = a, *y = b;
+	if(x->addr != y->addr) { return x->addr < y->addr ? -1 : 1; }
+	return y->is_func - x->is_func;
+}
+
+/* Add the functions and code labels of the symbol table of `elf'. */
+static bool load_symbols(const char *elf) {
+	FILE *fp = fopen(elf, "rb");
+	Elf32_Ehdr eh;
+	Elf32_Shdr *sh = NULL;
+	Elf32_Sym sym;
+	char *strtab = NULL;
+	bool ok = false;
+	int i, j, n;
+
+	if(fp == NULL) { return false; }
+	if(fread(&eh, sizeof(eh), 1, fp) != 1 || memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+			eh.e_ident[EI_CLASS] != ELFCLASS32 || eh.e_ident[EI_DATA] != ELFDATA2LSB ||
+			eh.e_shentsize != sizeof(Elf32_Shdr)) {
+		goto out;
+	}
+
+	sh = malloc(eh.e_shnum * sizeof(Elf32_Shdr));
+	if(sh == NULL || fseek(fp, eh.e_shoff, SEEK_SET) != 0 ||
+			fread(sh, sizeof(Elf32_Shdr), eh.e_shnum, fp) != eh.e_shnum) {
+		goto out;
+	}
+
+	for(i = 0; i < eh.e_shnum; i ++) {
+		if(sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= eh.e_shnum) { continue; }
+
+		Elf32_Shdr *str = &sh[sh[i].sh_link];
+		strtab = malloc(str->sh_size + 1);
+		if(strtab == NULL || fseek(fp, str->sh_offset, SEEK_SET) != 0 ||
+				fread(strtab, 1, str->sh_size, fp) != str->sh_size) {
+			goto out;
+		}
+		strtab[str->sh_size] = '\0';
+
+		n = sh[i].sh_size / sizeof(Elf32_Sym);
+		for(j = 0; j < n; j ++) {
+			if(fseek(fp, sh[i].sh_offset + j * sizeof(Elf32_Sym), SEEK_SET) != 0 ||
+					fread(&sym, sizeof(sym), 1, fp) != 1) {
+				goto out;
+			}
+
+			int type = ELF32_ST_TYPE(sym.st_info);
+			const char *name = sym.st_name < str->sh_size ? strtab + sym.st_name : "";
+			if(type != STT_FUNC && type != STT_NOTYPE) { continue; }
+			if(sym.st_shndx == SHN_UNDEF || sym.st_shndx >= eh.e_shnum ||
+					!(sh[sym.st_shndx].sh_flags & SHF_EXECINSTR)) {
+				continue;
+			}
+			if(name[0] == '\0' || name[0] == '.' || name[0] == '$') { continue; }
+
+			new_func(name, sym.st_value, sym.st_value + sym.st_size, type == STT_FUNC);
+		}
+		free(strtab);
+		strtab = NULL;
+	}
+	ok = true;
+
+out:
+	free(strtab);
+	free(sh);
+	fclose(fp);
+	return ok;
+}
+
+/* Sort the symbols and keep one per address, a symbol without a size
+ * ends at the next one.
+ */
+static void sort_symbols() {
+	int i, n = 1;
+	qsort(funcs + 1, nr_func - 1, sizeof(Func), func_cmp);
+	for(i = 1; i < nr_func; i ++) {
+		if(n > 1 && funcs[i].addr == funcs[n - 1].addr) {
+			free(funcs[i].name);
+			continue;
+		}
+		funcs[n ++] = funcs[i];
+	}
+	nr_func = nr_sym = n;
+	for(i = 1; i < nr_sym; i ++) {
+		if(funcs[i].end == funcs[i].addr) {
+			funcs[i].end = i + 1 < nr_sym ? funcs[i + 1].addr : funcs[i].addr + 4;
+		}
+	}
+}
+
+/* the symbol containing `addr', 0 if none */
+static int find_symbol(uint32_t addr) {
+	int lo = 1, hi = nr_sym - 1;
+	while(lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if(funcs[mid].addr <= addr) { lo = mid + 1; }
+		else { hi = mid - 1; }
+	}
+	return hi >= 1 && addr < funcs[hi].end ? hi : 0;
+}
+
+/* the function called at `target', a new one if it is not in a symbol */
+static int func_at(uint32_t target) {
+	int *v = map_find(&entry_map, target);
+	if(*v < 0) {
+		int f = find_symbol(target);
+		if(f == 0) {
+			char name[16];
+			sprintf(name, "0x%08x", target);
+			f = new_func(name, target, target + 4, false);
+		}
+		*v = f;
+	}
+	return *v;
+}
+
+static int edge_of(int caller, int callee) {
+	int *v = map_find(&edge_map, ((uint64_t)caller << 32) | (uint32_t)callee);
+	if(*v < 0) {
+		if(nr_edge == max_edge) {
+			max_edge = max_edge ? max_edge * 2 : 256;
+			edges = realloc(edges, max_edge * sizeof(Edge));
+			Assert(edges, "Can not allocate the profiler");
+		}
+		edges[nr_edge] = (Edge) { .caller = caller, .callee = callee };
+		*v = nr_edge ++;
+	}
+	return *v;
+}
+
+static inline uint64_t elapsed(uint64_t *since, uint64_t now) {
+	/* nr_instr goes back after `rsi' */
+	uint64_t d = now > *since ? now - *since : 0;
+	*since = now;
+	return d;
+}
+
+static void pop(uint64_t now) {
+	Frame *fr = &stack[-- depth];
+	uint64_t cost = elapsed(&fr->entry, now);
+	edges[fr->edge].inclusive += cost;
+	/* the outermost frame of a recursion counts for the function */
+	if(-- funcs[fr->func].active == 0) { funcs[fr->func].inclusive += cost; }
+}
+
+/* The call or return at nr_instr + 1 and its delay slot are charged to
+ * the frame on top before it.
+ */
+static void profile_call(uint32_t pc, uint32_t target) {
+	uint64_t now = nr_instr + 2;
+	int caller = stack[depth - 1].func, callee = func_at(target);
+	Frame *fr;
+
+	funcs[caller].self += elapsed(&mark, now);
+
+	if(depth == max_depth) {
+		max_depth *= 2;
+		stack = realloc(stack, max_depth * sizeof(Frame));
+		Assert(stack, "Can not allocate the profiler");
+	}
+	fr = &stack[depth ++];
+	fr->func = callee;
+	fr->edge = edge_of(caller, callee);
+	fr->ret_addr = pc + 8;
+	fr->entry = now;
+
+	edges[fr->edge].calls ++;
+	funcs[callee].calls ++;
+	funcs[callee].active ++;
+	m_calls.count ++;
+}
+
+static void profile_ret(uint32_t pc, uint32_t target) {
+	uint64_t now = nr_instr + 2;
+	int i;
+
+	for(i = depth - 1; i > 0 && depth - i <= MAX_UNWIND; i --) {
+		if(stack[i].ret_addr == target) { break; }
+	}
+	/* not a return from a call we saw */
+	if(i == 0 || stack[i].ret_addr != target) { return; }
+
+	funcs[stack[depth - 1].func].self += elapsed(&mark, now);
+	while(depth > i) { pop(now); }
+}
+
+static Observer profile_observer = { .name = "profile", .call = profile_call, .ret = profile_ret };
+
+static void free_profile() {
+	int i;
+	for(i = 0; i < nr_func; i ++) { free(funcs[i].name); }
+	free(funcs);
+	free(edges);
+	free(stack);
+	map_free(&entry_map);
+	map_free(&edge_map);
+	funcs = NULL;
+	edges = NULL;
+	stack = NULL;
+	nr_func = nr_sym = max_func = nr_edge = max_edge = 0;
+}
+
+bool profile_enable(const char *elf) {
+	profile_disable();
+
+	new_func("[unknown]", 0, 0, false);
+	if(elf != NULL && !load_symbols(elf)) {
+		free_profile();
+		return false;
+	}
+	sort_symbols();
+	map_init(&entry_map, 1024);
+	map_init(&edge_map, 1024);
+
+	max_depth = 256;
+	stack = malloc(max_depth * sizeof(Frame));
+	Assert(stack, "Can not allocate the profiler");
+	stack[0] = (Frame) { .func = find_symbol(cpu.pc), .edge = -1, .entry = nr_instr };
+	funcs[stack[0].func].active = 1;
+	depth = 1;
+	mark = nr_instr;
+
+	metric_register(&m_calls);
+	register_observer(&profile_observer);
+	enabled = true;
+	return true;
+}
+
+void profile_disable() {
+	if(!enabled) { return; }
+	unregister_observer(&profile_observer);
+	free_profile();
+	enabled = false;
+}
+
+/* Charge the instructions up to now to the frames on the stack. */
+static void settle() {
+	uint64_t now = nr_instr;
+	int i;
+
+	funcs[stack[depth - 1].func].self += elapsed(&mark, now);
+	for(i = 0; i < depth; i ++) {
+		Frame *fr = &stack[i];
+		uint64_t cost = elapsed(&fr->entry, now);
+		if(fr->edge >= 0) { edges[fr->edge].inclusive += cost; }
+		/* a function is on the stack since its first frame */
+		if(funcs[fr->func].active > 0) {
+			funcs[fr->func].inclusive += cost;
+			funcs[fr->func].active = -funcs[fr->func].active;
+		}
+	}
+	for(i = 0; i < depth; i ++) {
+		if(funcs[stack[i].func].active < 0) { funcs[stack[i].func].active = -funcs[stack[i].func].active; }
+	}
+}
+
+static int inclusive_cmp(const void *a, const void *b) {
+	const Func *x = &funcs[*(const int *)a], *y = &funcs[*(const int *)b];
+	if(x->inclusive != y->inclusive) { return x->inclusive > y->inclusive ? -1 : 1; }
+	return x->self < y->self ? 1 : (x->self > y->self ? -1 : 0);
+}
+
+void profile_report(FILE *fp) {
+	uint64_t total = 0;
+	int *order, i, n = 0;
+
+	if(!enabled) {
+		fprintf(fp, "The profiler is off.\n");
+		return;
+	}
+
+	settle();
+	order = malloc(nr_func * sizeof(int));
+	Assert(order, "Can not allocate the profiler");
+	for(i = 0; i < nr_func; i ++) {
+		total += funcs[i].self;
+		if(funcs[i].self || funcs[i].inclusive) { order[n ++] = i; }
+	}
+	qsort(order, n, sizeof(int), inclusive_cmp);
+
+	fprintf(fp, "%" PRIu64 " instructions, %" PRIu64 " calls, %d functions\n", total, m_calls.count, n);
+	fprintf(fp, "  %14s %7s %14s %7s %10s  %s\n", "inclusive", "", "exclusive", "", "calls", "function");
+	for(i = 0; i < n && i < NR_TOP_FUNC; i ++) {
+		Func *f = &funcs[order[i]];
+		fprintf(fp, "  %14" PRIu64 " %6.2f%% %14" PRIu64 " %6.2f%% %10" PRIu64 "  %s\n",
+				f->inclusive, total ? 100.0 * f->inclusive / total : 0.0,
+				f->self, total ? 100.0 * f->self / total : 0.0, f->calls, f->name);
+	}
+	free(order);
+}
+
+/* "(id) name" the first time, "(id)" afterwards */
+static void callgrind_name(FILE *fp, const char *key, int f, bool *named) {
+	if(named[f]) { fprintf(fp, "%s=(%d)\n", key, f); }
+	else {
+		fprintf(fp, "%s=(%d) %s\n", key, f, funcs[f].name);
+		named[f] = true;
+	}
+}
+
+static int caller_cmp(const void *a, const void *b) {
+	const Edge *x = &edges[*(const int *)a], *y = &edges[*(const int *)b];
+	return x->caller != y->caller ? x->caller - y->caller : x->callee - y->callee;
+}
+
+bool profile_write_callgrind(const char *filename) {
+	FILE *fp;
+	bool *named;
+	int *order;
+	uint64_t total = 0;
+	int i, j = 0;
+
+	if(!enabled || (fp = fopen(filename, "w")) == NULL) { return false; }
+
+	settle();
+	for(i = 0; i < nr_func; i ++) { total += funcs[i].self; }
+
+	fprintf(fp, "# callgrind format\nversion: 1\ncreator: temu\n");
+	fprintf(fp, "positions: instr\nevents: Ir\nsummary: %" PRIu64 "\n\n", total);
+
+	named = calloc(nr_func, sizeof(bool));
+	order = malloc((nr_edge + 1) * sizeof(int));
+	Assert(named && order, "Can not allocate the profiler");
+	for(i = 0; i < nr_edge; i ++) { order[i] = i; }
+	qsort(order, nr_edge, sizeof(int), caller_cmp);
+
+	/* a function, its own instructions and the calls it made */
+	for(i = 0; i < nr_func; i ++) {
+		Func *f = &funcs[i];
+		bool calls = j < nr_edge && edges[order[j]].caller == i;
+		if(f->self == 0 && !calls) { continue; }
+
+		callgrind_name(fp, "fn", i, named);
+		fprintf(fp, "0x%x %" PRIu64 "\n", f->addr, f->self);
+		for(; j < nr_edge && edges[order[j]].caller == i; j ++) {
+			Edge *e = &edges[order[j]];
+			callgrind_name(fp, "cfn", e->callee, named);
+			fprintf(fp, "calls=%" PRIu64 " 0x%x\n", e->calls, funcs[e->callee].addr);
+			fprintf(fp, "0x%x %" PRIu64 "\n", f->addr, e->inclusive);
+		}
+		fprintf(fp, "\n");
+	}
+	free(order);
+	free(named);
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,307 @@
+#include "perf/simpoint.h"
+#include "perf/observer.h"
+#include "perf/metrics.h"
+#include "monitor/monitor.h"
+#include "monitor/mode.h"
+#include "device/event.h"
+#include "temu.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* basic-block vectors */
+
+static FILE *bbv_fp = NULL;
+static uint64_t bbv_interval, bbv_left;
+
+static uint32_t block_pc, block_len;
+
+/* open addressing from the start of a block to its id */
+static uint32_t *block_keys;
+static int *block_ids;
+static uint32_t block_mask;
+static int nr_block;
+
+/* instructions of each block in this interval, and the blocks run in it */
+static uint64_t *block_count;
+static int *touched;
+static int nr_touched;
+
+static void block_table_init(uint32_t size) {
+	block_keys = malloc(size * sizeof(uint32_t));
+	block_ids = malloc(size * sizeof(int));
+	Assert(block_keys && block_ids, "Can not allocate the basic-block vectors");
+	memset(block_ids, -1, size * sizeof(int));
+	block_mask = size - 1;
+}
+
+static int block_id(uint32_t pc) {
+	uint32_t i = (pc * 0x9e3779b1u >> 7) & block_mask;
+	while(block_ids[i] >= 0 && block_keys[i] != pc) { i = (i + 1) & block_mask; }
+	if(block_ids[i] >= 0) { return block_ids[i]; }
+
+	block_keys[i] = pc;
+	block_ids[i] = nr_block ++;
+
+	if(nr_block * 2 > block_mask) {
+		/* grow, the ids stay */
+		uint32_t *keys = block_keys, j, size = block_mask + 1;
+		int *ids = block_ids;
+		block_table_init(size * 2);
+		for(j = 0; j < size; j ++) {
+			if(ids[j] < 0) { continue; }
+			i = (keys[j] * 0x9e3779b1u >> 7) & block_mask;
+			while(block_ids[i] >= 0) { i = (i + 1) & block_mask; }
+			block_keys[i] = keys[j];
+			block_ids[i] = ids[j];
+		}
+		free(keys);
+		free(ids);
+
+		block_count = realloc(block_count, (block_mask + 1) / 2 * sizeof(uint64_t));
+		touched = realloc(touched, (block_mask + 1) / 2 * sizeof(int));
+		Assert(block_count && touched, "Can not allocate the basic-block vectors");
+		memset(block_count + size / 2, 0, size / 2 * sizeof(uint64_t));
+	}
+	return nr_block - 1;
+}
+
+static void end_block() {
+	int id;
+	if(block_len == 0) { return; }
+	id = block_id(block_pc);
+	if(block_count[id] == 0) { touched[nr_touched ++] = id; }
+	block_count[id] += block_len;
+	block_len = 0;
+}
+
+static void write_vector() {
+	int i;
+	fputc('T', bbv_fp);
+	for(i = 0; i < nr_touched; i ++) {
+		/* the ids of the .bb format start at 1 */
+		fprintf(bbv_fp, ":%d:%" PRIu64 " ", touched[i] + 1, block_count[touched[i]]);
+		block_count[touched[i]] = 0;
+	}
+	fputc('\n', bbv_fp);
+	nr_touched = 0;
+}
+
+static void bbv_retire(uint32_t pc, uint32_t instr, uint32_t npc) {
+	block_len ++;
+	if(npc != pc + 4) {
+		end_block();
+		block_pc = npc;
+	}
+	if(-- bbv_left == 0) {
+		end_block();
+		write_vector();
+		bbv_left = bbv_interval;
+	}
+}
+
+static Observer bbv_observer = { .name = "bbv", .retire = bbv_retire };
+
+bool bbv_enable(const char *filename, uint64_t interval) {
+	bbv_disable();
+	bbv_fp = fopen(filename, "w");
+	if(bbv_fp == NULL) { return false; }
+
+	block_table_init(1 << 12);
+	block_count = calloc(1 << 11, sizeof(uint64_t));
+	touched = malloc((1 << 11) * sizeof(int));
+	Assert(block_count && touched, "Can not allocate the basic-block vectors");
+	nr_block = nr_touched = 0;
+
+	bbv_interval = bbv_left = interval;
+	block_pc = cpu.pc;
+	block_len = 0;
+	register_observer(&bbv_observer);
+	return true;
+}
+
+void bbv_disable() {
+	if(bbv_fp == NULL) { return; }
+	unregister_observer(&bbv_observer);
+	fclose(bbv_fp);
+	bbv_fp = NULL;
+	free(block_keys);
+	free(block_ids);
+	free(block_count);
+	free(touched);
+	block_count = NULL;
+	touched = NULL;
+}
+
+/* sampled simulation */
+
+typedef struct {
+	uint64_t interval;
+	double weight;
+} Point;
+
+typedef struct {
+	Metric *m;
+	uint64_t start;		/* at the start of the interval in detail */
+	double sum;		/* weighted changes in the intervals in detail */
+} Estimate;
+
+static bool sampling = false;
+static uint64_t sample_interval, sample_start;
+static Point *points;
+static int nr_point, next_point;
+static double weight_done;
+
+static Estimate *ests;
+static int nr_est, max_est;
+
+/* dram.accesses at the start of the run */
+static uint64_t accesses_start;
+static Metric *m_accesses;
+
+static Metric m_detail = { .name = "sample.detailed_instructions", .unit = "instructions", .type = METRIC_COUNTER };
+
+static void snapshot() {
+	Metric *m;
+	int i;
+
+	/* metrics may have been registered since the last interval */
+	for(m = metrics_first(); m != NULL; m = m->next) {
+		if(m->type != METRIC_COUNTER) { continue; }
+		for(i = 0; i < nr_est && ests[i].m != m; i ++);
+		if(i == nr_est) {
+			if(nr_est == max_est) {
+				max_est = max_est ? max_est * 2 : 64;
+				ests = realloc(ests, max_est * sizeof(Estimate));
+				Assert(ests, "Can not allocate the sampled estimates");
+			}
+			ests[nr_est].m = m;
+			ests[nr_est].sum = 0;
+			nr_est ++;
+		}
+		ests[i].start = metric_counter_value(m);
+	}
+}
+
+static void sample_end(void *arg);
+
+static void sample_begin(void *arg) {
+	mode_set(false);
+	snapshot();
+	event_schedule(nr_instr + sample_interval, sample_end, NULL);
+}
+
+static void sample_end(void *arg) {
+	double w = points[next_point].weight;
+	int i;
+
+	for(i = 0; i < nr_est; i ++) {
+		ests[i].sum += w * (metric_counter_value(ests[i].m) - ests[i].start);
+	}
+	weight_done += w;
+	m_detail.count += sample_interval;
+
+	mode_set(true);
+	if(++ next_point < nr_point) {
+		event_schedule(sample_start + points[next_point].interval * sample_interval, sample_begin, NULL);
+	}
+}
+
+static int point_cmp(const void *a, const void *b) {
+	uint64_t x = ((const Point *)a)->interval, y = ((const Point *)b)->interval;
+	return x < y ? -1 : x > y;
+}
+
+static bool load_points(const char *prefix) {
+	char name[256];
+	FILE *fp;
+	double w, weights[256] = { 0 };
+	uint64_t interval;
+	int cluster, max_point = 0, i;
+
+	snprintf(name, sizeof(name), "%s.weights", prefix);
+	fp = fopen(name, "r");
+	if(fp == NULL) { return false; }
+	while(fscanf(fp, "%lf %d", &w, &cluster) == 2) {
+		if(cluster >= 0 && cluster < 256) { weights[cluster] = w; }
+	}
+	fclose(fp);
+
+	snprintf(name, sizeof(name), "%s.simpoints", prefix);
+	fp = fopen(name, "r");
+	if(fp == NULL) { return false; }
+	nr_point = 0;
+	while(fscanf(fp, "%" SCNu64 " %d", &interval, &cluster) == 2) {
+		if(cluster < 0 || cluster >= 256) { continue; }
+		if(nr_point == max_point) {
+			max_point = max_point ? max_point * 2 : 16;
+			points = realloc(points, max_point * sizeof(Point));
+			Assert(points, "Can not allocate the simulation points");
+		}
+		points[nr_point].interval = interval;
+		points[nr_point].weight = weights[cluster];
+		nr_point ++;
+	}
+	fclose(fp);
+
+	qsort(points, nr_point, sizeof(Point), point_cmp);
+	for(i = 1; i < nr_point; i ++) {
+		Assert(points[i].interval != points[i - 1].interval, "interval %" PRIu64 " is picked twice", points[i].interval);
+	}
+	return nr_point > 0;
+}
+
+bool sample_enable(const char *prefix, uint64_t interval) {
+	Metric *m;
+
+	if(sampling || !load_points(prefix)) { return false; }
+
+	metric_register(&m_detail);
+	for(m = metrics_first(); m != NULL && strcmp(m->name, "dram.accesses") != 0; m = m->next);
+	m_accesses = m;
+	accesses_start = m ? metric_counter_value(m) : 0;
+
+	sampling = true;
+	sample_interval = interval;
+	sample_start = nr_instr;
+	next_point = 0;
+	weight_done = 0;
+
+	mode_set(true);
+	if(points[0].interval == 0) { sample_begin(NULL); }
+	else { event_schedule(sample_start + points[0].interval * sample_interval, sample_begin, NULL); }
+	return true;
+}
+
+void sample_report(FILE *fp) {
+	uint64_t run = nr_instr - sample_start;
+	double scale;
+	int i;
+
+	if(!sampling) {
+		fprintf(fp, "Sampled simulation is off\n");
+		return;
+	}
+
+	fprintf(fp, "%d of %d simulation points run in detail, %" PRIu64 " of %" PRIu64 " instructions\n",
+			next_point, nr_point, m_detail.count, run);
+	if(weight_done == 0) { return; }
+
+	/* the estimate of one interval, times the intervals of the run */
+	scale = (double)run / sample_interval;
+
+	fprintf(fp, "%-36s %16s %16s\n", "counter", "per interval", "whole run");
+	for(i = 0; i < nr_est; i ++) {
+		double per = ests[i].sum / weight_done;
+		if(ests[i].sum == 0 || ests[i].m == &m_detail) { continue; }
+		fprintf(fp, "%-36s %16.1f %16.0f\n", ests[i].m->name, per, per * scale);
+	}
+
+	for(i = 0; i < nr_est && ests[i].m != m_accesses; i ++);
+	if(i < nr_est && m_accesses != NULL) {
+		double real = metric_counter_value(m_accesses) - accesses_start;
+		double est = ests[i].sum / weight_done * scale;
+		fprintf(fp, "dram.accesses: estimated %.0f, counted %.0f, error %.2f%%\n",
+				est, real, real ? (est - real) * 100 / real : 0.0);
+	}
+}
@@ -0,0 +1,426 @@
+#include "helper.h"
+#include "isa.h"
+#include "disasm.h"
+#include "perf/timing.h"
+#include "perf/observer.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* A cycle-approximate model of the 5-stage MiniMIPS32_Lite pipeline.
+ * Instead of simulating every cycle, the model computes for each retired
+ * instruction the cycle in which it enters every stage, from the stage
+ * times of the previous instruction and the cycles in which its source
+ * operands become available. This is O(1) per instruction.
+ */
+
+#define NR_TREG 34	/* 32 GPRs, HI and LO */
+#define TREG_HI 32
+#define TREG_LO 33
+#define TREG_NONE -1
+
+TimingConfig timing_config = {
+	.forwarding = true,
+	.branch_stage = TM_ID,
+	.ifetch_wait = 0,
+	.dmem_wait = 0,
+	.mul_latency = 4,
+	.div_latency = 32,
+};
+
+typedef struct {
+	int src[2];
+	int dest[2];
+	int ex_latency;
+	bool load, store, control, jump;
+} InstrInfo;
+
+static const char *class_name[NR_TM_CLASS] = {
+	"retiring", "fetch-bound", "branch-flush", "load-use/memory", "multi-cycle-op"
+};
+
+static const char *stage_name[NR_TM_STAGE] = { "F", "D", "X", "M", "W" };
+
+static int64_t last[NR_TM_STAGE];	/* stage entry cycles of the previous instruction */
+static int64_t ready[NR_TREG];		/* first cycle a register value can be read */
+static int ready_class[NR_TREG];	/* class of the producer, TM_RETIRE for ALU results */
+static int64_t resolve;			/* first cycle the last control transfer can fetch */
+static uint32_t last_pc;
+static uint64_t retired;
+static uint64_t cycles[NR_TM_CLASS];
+
+/* Kanata export window */
+typedef struct {
+	uint32_t pc;
+	int64_t stage[NR_TM_STAGE];
+	char text[80];
+} KanataRecord;
+
+static FILE *kanata_fp = NULL;
+static KanataRecord *kanata_buf = NULL;
+static uint64_t kanata_start, kanata_count, kanata_nr;
+
+static const uint8_t isa_format[NR_ISA_INSTR] = {
+#define ISA_FORMAT(id, name, index, format) [I_##id] = format,
+	ISA_TABLE(ISA_FORMAT)
+#undef ISA_FORMAT
+};
+
+/* The operands follow from the format of the instruction in the ISA
+ * table, only the implicit ones (HI/LO, the link register) and the
+ * latencies are per instruction.
+ */
+static void classify(uint32_t instr, InstrInfo *info) {
+	int id = isa_decode(instr);
+	int rs = isa_rs(instr), rt = isa_rt(instr), rd = isa_rd(instr);
+
+	info->src[0] = info->src[1] = TREG_NONE;
+	info->dest[0] = info->dest[1] = TREG_NONE;
+	info->ex_latency = 1;
+	info->load = info->store = info->control = info->jump = false;
+
+	if(id == I_INVALID) { return; }
+
+	switch(isa_format[id]) {
+		case F_RD_RS_RT:
+			info->src[0] = rs; info->src[1] = rt; info->dest[0] = rd; break;
+		case F_RD_RT_SA:
+			info->src[0] = rt; info->dest[0] = rd; break;
+		case F_RD_RT_RS:
+			info->src[0] = rt; info->src[1] = rs; info->dest[0] = rd; break;
+		case F_RS:
+			info->src[0] = rs;
+			if(id == I_mthi) { info->dest[0] = TREG_HI; }
+			else if(id == I_mtlo) { info->dest[0] = TREG_LO; }
+			else { info->control = true; }	/* jr */
+			break;
+		case F_RD:
+			info->src[0] = id == I_mfhi ? TREG_HI : TREG_LO; info->dest[0] = rd; break;
+		case F_RS_RT:
+			info->src[0] = rs; info->src[1] = rt;
+			switch(id) {
+				case I_mult: case I_multu: case I_madd: case I_maddu: case I_msub: case I_msubu:
+				case I_div: case I_divu:
+					info->dest[0] = TREG_HI; info->dest[1] = TREG_LO; break;
+			}
+			break;
+		case F_RD_RS:
+			info->src[0] = rs; info->dest[0] = rd;
+			if(id == I_jalr) { info->control = true; }
+			break;
+		case F_RT_RS_IMM:
+			info->src[0] = rs; info->dest[0] = rt; break;
+		case F_RT_IMM:
+			info->dest[0] = rt; break;
+		case F_RT_MEM:
+			info->src[0] = rs;
+			switch(id) {
+				case I_sb: case I_sh: case I_swl: case I_sw: case I_swr:
+					info->store = true; info->src[1] = rt; break;
+				case I_sc:
+					info->store = true; info->src[1] = rt; info->dest[0] = rt; break;
+				case I_lwl: case I_lwr:
+					info->load = true; info->src[1] = rt; info->dest[0] = rt; break;
+				default:
+					info->load = true; info->dest[0] = rt; break;
+			}
+			break;
+		case F_RS_RT_BRANCH:
+			info->src[0] = rs; info->src[1] = rt; info->control = true; break;
+		case F_RS_BRANCH:
+			info->src[0] = rs; info->control = true;
+			switch(id) {
+				case I_bltzal: case I_bgezal: case I_bltzall: case I_bgezall:
+					info->dest[0] = R_RA; break;
+			}
+			break;
+		case F_RS_SIMM:
+			info->src[0] = rs; break;
+		case F_JUMP:
+			info->control = info->jump = true;
+			if(id == I_jal) { info->dest[0] = R_RA; }
+			break;
+		case F_RT_CP0:
+			if(id == I_mfc0) { info->dest[0] = rt; }
+			else { info->src[0] = rt; }
+			break;
+		case F_NONE: case F_CACHE:
+			break;
+	}
+
+	switch(id) {
+		case I_mult: case I_multu: case I_madd: case I_maddu: case I_msub: case I_msubu: case I_mul:
+			info->ex_latency = timing_config.mul_latency; break;
+		case I_div: case I_divu:
+			info->ex_latency = timing_config.div_latency; break;
+	}
+
+	/* writes to $zero are discarded */
+	if(info->dest[0] == R_ZERO) { info->dest[0] = TREG_NONE; }
+}
+
+static inline int64_t max64(int64_t a, int64_t b) { return a > b ? a : b; }
+
+static void kanata_record(uint32_t pc, uint32_t instr, const int64_t *stage) {
+	uint64_t seq = retired - 1;
+	if(seq < kanata_start || seq >= kanata_start + kanata_count) { return; }
+
+	KanataRecord *r = &kanata_buf[kanata_nr ++];
+	r->pc = pc;
+	memcpy(r->stage, stage, sizeof(r->stage));
+	disasm(pc, instr, r->text, sizeof(r->text));
+
+	if(kanata_nr == kanata_count) { timing_kanata_close(); }
+}
+
+static void timing_retire(uint32_t pc, uint32_t instr, uint32_t npc) {
+	InstrInfo info;
+	int64_t stall[NR_TM_CLASS] = { 0 };
+	int64_t s[NR_TM_STAGE], need;
+	int i, c;
+
+	classify(instr, &info);
+
+	bool read_in_id = !timing_config.forwarding || (info.control && timing_config.branch_stage == TM_ID);
+	int mem_latency = 1 + ((info.load || info.store) ? timing_config.dmem_wait : 0);
+
+	/* IF: in order, and only after the previous instruction left IF */
+	s[TM_IF] = max64(last[TM_IF] + 1, last[TM_ID]);
+	if(retired > 0 && pc != last_pc + 4 && resolve > s[TM_IF]) {
+		stall[TM_BRANCH] += resolve - s[TM_IF];
+		s[TM_IF] = resolve;
+	}
+
+	/* ID */
+	s[TM_ID] = max64(s[TM_IF] + 1, last[TM_EX]);
+	need = s[TM_IF] + 1 + timing_config.ifetch_wait;
+	if(need > s[TM_ID]) {
+		stall[TM_FETCH] += need - s[TM_ID];
+		s[TM_ID] = need;
+	}
+
+	/* EX: wait for the source operands */
+	s[TM_EX] = max64(s[TM_ID] + 1, last[TM_MEM]);
+	for(i = 0; i < 2; i ++) {
+		if(info.src[i] == TREG_NONE || info.src[i] == R_ZERO) { continue; }
+		need = ready[info.src[i]] + (read_in_id ? 1 : 0);
+		if(need > s[TM_EX]) {
+			/* an ALU result is late only for branches resolved in ID,
+			 * or without forwarding
+			 */
+			c = ready_class[info.src[i]];
+			if(c == TM_RETIRE) { c = info.control && timing_config.forwarding ? TM_BRANCH : TM_MEMORY; }
+			stall[c] += need - s[TM_EX];
+			s[TM_EX] = need;
+		}
+	}
+
+	/* MEM: multi-cycle operations stay in EX */
+	s[TM_MEM] = max64(s[TM_EX] + 1, last[TM_WB]);
+	need = s[TM_EX] + info.ex_latency;
+	if(need > s[TM_MEM]) {
+		stall[TM_MULTICYCLE] += need - s[TM_MEM];
+		s[TM_MEM] = need;
+	}
+
+	/* WB: data memory wait states */
+	s[TM_WB] = max64(s[TM_MEM] + 1, last[TM_WB] + 1);
+	need = s[TM_MEM] + mem_latency;
+	if(need > s[TM_WB]) {
+		stall[TM_MEMORY] += need - s[TM_WB];
+		s[TM_WB] = need;
+	}
+
+	/* Account the cycles since the previous retirement. One of them retires
+	 * this instruction, the others are blamed on the stalls of this instruction,
+	 * the remainder (e.g. pipeline fill) on the front end.
+	 */
+	int64_t gap = s[TM_WB] - last[TM_WB] - 1;
+	static const int blame_order[] = { TM_MEMORY, TM_MULTICYCLE, TM_BRANCH, TM_FETCH };
+	cycles[TM_RETIRE] ++;
+	for(i = 0; i < sizeof(blame_order) / sizeof(blame_order[0]) && gap > 0; i ++) {
+		c = blame_order[i];
+		int64_t n = stall[c] < gap ? stall[c] : gap;
+		cycles[c] += n;
+		gap -= n;
+	}
+	cycles[TM_FETCH] += gap;
+
+	/* publish the results */
+	for(i = 0; i < 2; i ++) {
+		int r = info.dest[i];
+		if(r == TREG_NONE) { continue; }
+		if(!timing_config.forwarding) {
+			ready[r] = s[TM_WB];
+		}
+		else if(info.load) {
+			ready[r] = s[TM_MEM] + mem_latency;
+		}
+		else {
+			ready[r] = s[TM_EX] + info.ex_latency;
+		}
+		ready_class[r] = info.load ? TM_MEMORY : (info.ex_latency > 1) ? TM_MULTICYCLE : TM_RETIRE;
+	}
+
+	if(info.control) {
+		/* the target is fetched in the cycle after the branch leaves the resolving stage */
+		resolve = info.jump ? s[TM_EX] : s[timing_config.branch_stage + 1];
+	}
+
+	memcpy(last, s, sizeof(last));
+	last_pc = pc;
+	retired ++;
+
+	if(kanata_fp != NULL) { kanata_record(pc, instr, s); }
+}
+
+static Observer timing_observer = { .name = "timing", .retire = timing_retire };
+
+void timing_reset() {
+	int i;
+	for(i = 0; i < NR_TM_STAGE; i ++) { last[i] = -1; }
+	for(i = 0; i < NR_TREG; i ++) { ready[i] = 0; ready_class[i] = TM_RETIRE; }
+	resolve = 0;
+	last_pc = 0;
+	retired = 0;
+	memset(cycles, 0, sizeof(cycles));
+}
+
+void timing_enable(bool enable) {
+	if(enable) {
+		timing_reset();
+		register_observer(&timing_observer);
+	}
+	else {
+		unregister_observer(&timing_observer);
+		timing_kanata_close();
+	}
+}
+
+bool timing_enabled() {
+	Observer *o;
+	for(o = observers; o != NULL; o = o->next) {
+		if(o == &timing_observer) { return true; }
+	}
+	return false;
+}
+
+void timing_report(FILE *fp) {
+	uint64_t total = last[TM_WB] + 1;
+	int i;
+
+	fprintf(fp, "Timing model: %s, forwarding %s, branches resolved in %s\n",
+			timing_enabled() ? "on" : "off", timing_config.forwarding ? "on" : "off",
+			timing_config.branch_stage == TM_ID ? "ID" : "EX");
+	fprintf(fp, "  ifetch wait %d, dmem wait %d, mul latency %d, div latency %d\n",
+			timing_config.ifetch_wait, timing_config.dmem_wait,
+			timing_config.mul_latency, timing_config.div_latency);
+	fprintf(fp, "  instructions  %" PRIu64 "\n", retired);
+	fprintf(fp, "  cycles        %" PRIu64 "\n", total);
+	if(retired == 0) { return; }
+
+	fprintf(fp, "  CPI           %.3f\n", (double)total / retired);
+	for(i = 0; i < NR_TM_CLASS; i ++) {
+		fprintf(fp, "  %-16s %12" PRIu64 "  %5.1f%%\n", class_name[i], cycles[i], 100.0 * cycles[i] / total);
+	}
+}
+
+/* Kanata log format, see https://github.com/shioyadan/Konata/blob/master/docs/kanata-log-format.md */
+
+enum { KE_INSN, KE_LABEL, KE_STAGE, KE_RETIRE };
+
+typedef struct {
+	int64_t cycle;
+	uint64_t id;
+	int kind, stage;
+} KanataEvent;
+
+static int kanata_event_cmp(const void *a, const void *b) {
+	const KanataEvent *x = a, *y = b;
+	if(x->cycle != y->cycle) { return x->cycle < y->cycle ? -1 : 1; }
+	if(x->id != y->id) { return x->id < y->id ? -1 : 1; }
+	if(x->kind != y->kind) { return x->kind - y->kind; }
+	return x->stage - y->stage;
+}
+
+static void kanata_dump() {
+	size_t nr_event = kanata_nr * (NR_TM_STAGE + 3);
+	KanataEvent *ev = malloc(nr_event * sizeof(KanataEvent));
+	Assert(ev, "Can not allocate the Kanata event buffer");
+
+	uint64_t i;
+	size_t n = 0;
+	int k;
+	for(i = 0; i < kanata_nr; i ++) {
+		KanataRecord *r = &kanata_buf[i];
+		ev[n ++] = (KanataEvent){ r->stage[TM_IF], i, KE_INSN, 0 };
+		ev[n ++] = (KanataEvent){ r->stage[TM_IF], i, KE_LABEL, 0 };
+		for(k = 0; k < NR_TM_STAGE; k ++) {
+			ev[n ++] = (KanataEvent){ r->stage[k], i, KE_STAGE, k };
+		}
+		ev[n ++] = (KanataEvent){ r->stage[TM_WB] + 1, i, KE_RETIRE, 0 };
+	}
+	qsort(ev, n, sizeof(KanataEvent), kanata_event_cmp);
+
+	fprintf(kanata_fp, "Kanata\t0004\n");
+	int64_t now = n > 0 ? ev[0].cycle : 0;
+	fprintf(kanata_fp, "C=\t%" PRId64 "\n", now);
+	for(i = 0; i < n; i ++) {
+		KanataEvent *e = &ev[i];
+		KanataRecord *r = &kanata_buf[e->id];
+		if(e->cycle != now) {
+			fprintf(kanata_fp, "C\t%" PRId64 "\n", e->cycle - now);
+			now = e->cycle;
+		}
+		switch(e->kind) {
+			case KE_INSN:
+				fprintf(kanata_fp, "I\t%" PRIu64 "\t%" PRIu64 "\t0\n", e->id, kanata_start + e->id);
+				break;
+			case KE_LABEL:
+				fprintf(kanata_fp, "L\t%" PRIu64 "\t0\t%08x: %s\n", e->id, r->pc, r->text);
+				break;
+			case KE_STAGE:
+				if(e->stage > 0) {
+					fprintf(kanata_fp, "E\t%" PRIu64 "\t0\t%s\n", e->id, stage_name[e->stage - 1]);
+				}
+				fprintf(kanata_fp, "S\t%" PRIu64 "\t0\t%s\n", e->id, stage_name[e->stage]);
+				break;
+			case KE_RETIRE:
+				fprintf(kanata_fp, "E\t%" PRIu64 "\t0\t%s\n", e->id, stage_name[TM_WB]);
+				fprintf(kanata_fp, "R\t%" PRIu64 "\t%" PRIu64 "\t0\n", e->id, e->id);
+				break;
+		}
+	}
+
+	free(ev);
+}
+
+bool timing_kanata(const char *filename, uint64_t start, uint64_t count) {
+	timing_kanata_close();
+	if(count == 0) { return false; }
+
+	kanata_fp = fopen(filename, "w");
+	if(kanata_fp == NULL) { return false; }
+
+	kanata_buf = malloc(count * sizeof(KanataRecord));
+	if(kanata_buf == NULL) {
+		fclose(kanata_fp);
+		kanata_fp = NULL;
+		return false;
+	}
+
+	kanata_start = start;
+	kanata_count = count;
+	kanata_nr = 0;
+	return true;
+}
+
+void timing_kanata_close() {
+	if(kanata_fp == NULL) { return; }
+
+	kanata_dump();
+	fclose(kanata_fp);
+	kanata_fp = NULL;
+	free(kanata_buf);
+	kanata_buf = NULL;
+}
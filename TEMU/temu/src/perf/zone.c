@@ -0,0 +1,57 @@
+#include "perf/zone.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define ZONE_BUF_SIZE (1 << 20)
+
+bool zone_enabled = false;
+
+static FILE *zone_fp = NULL;
+static uint64_t zone_epoch;
+static bool zone_first;
+
+uint64_t zone_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec + 1;
+}
+
+bool zone_open(const char *filename) {
+	zone_close();
+
+	zone_fp = fopen(filename, "w");
+	if(zone_fp == NULL) { return false; }
+	setvbuf(zone_fp, NULL, _IOFBF, ZONE_BUF_SIZE);
+
+	fprintf(zone_fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	zone_epoch = zone_now();
+	zone_first = true;
+	zone_enabled = true;
+	return true;
+}
+
+void zone_close() {
+	if(zone_fp == NULL) { return; }
+
+	zone_enabled = false;
+	fprintf(zone_fp, "\n]}\n");
+	fclose(zone_fp);
+	zone_fp = NULL;
+}
+
+/* Emit a complete ("X") event, timestamps are in microseconds. */
+void zone_emit(const char *name, uint64_t start) {
+	if(zone_fp == NULL) { return; }
+
+	uint64_t end = zone_now();
+	/* the GUI runs the emulator on a thread of its own */
+	flockfile(zone_fp);
+	fprintf(zone_fp, "%s{\"name\":\"%s\",\"cat\":\"temu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld}",
+			zone_first ? "" : ",\n", name, (start - zone_epoch) / 1000.0, (end - start) / 1000.0,
+			(int)getpid(), (long)syscall(SYS_gettid));
+	zone_first = false;
+	funlockfile(zone_fp);
+}
@@ -0,0 +1,376 @@
+/* simpoint: pick the representative intervals of a run from its
+ * basic-block vectors (temu --bbv), in the way of SimPoint.
+ *
+ *   simpoint [options] <bbv file>
+ *
+ * Every vector is normalised to a sum of 1 and projected to a few
+ * dimensions by a fixed random matrix. The projected vectors are
+ * clustered with k-means for k = 1 .. maxk, and the smallest k whose BIC
+ * score reaches 90% of the range of the scores is taken. The interval
+ * nearest to the center of each cluster is its simulation point, its
+ * weight is the share of the intervals in the cluster.
+ *
+ * Writes <prefix>.simpoints ("interval cluster" per line) and
+ * <prefix>.weights ("weight cluster" per line), which temu --simpoints
+ * reads, and prints the clusters with their spread: the mean distance of
+ * an interval to its simulation point, where 0 is the same code mix and 2
+ * none of the same blocks. The error of an estimate of a counter grows
+ * with the spread of the clusters.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define MAX_DIM 64
+#define NR_ITER 100
+#define NR_SEED 5
+
+typedef struct {
+	int id;
+	double count;
+} Entry;
+
+typedef struct {
+	Entry *e;
+	int n;
+} Vector;
+
+static int maxk = 10, fixed_k = 0, dim = 15;
+static const char *prefix = "simpoint";
+static double bic_threshold = 0.9;
+
+static Vector *vecs;
+static int nr_vec;
+static double *proj;		/* nr_vec x dim */
+
+static void usage(const char *prog) {
+	fprintf(stderr,
+		"Usage: %s [options] <bbv file>\n"
+		"  -k N          use N clusters\n"
+		"  -maxk N       try 1 to N clusters and pick by the BIC (default 10)\n"
+		"  -dim N        dimensions of the random projection (default 15)\n"
+		"  -o PREFIX     write PREFIX.simpoints and PREFIX.weights (default simpoint)\n",
+		prog);
+	exit(2);
+}
+
+/* a fixed pseudo-random number in [-1, 1) for each block and dimension */
+static double projection(int id, int d) {
+	uint64_t x = (uint64_t)id * 0x9e3779b97f4a7c15ull + (uint64_t)d * 0xbf58476d1ce4e5b9ull + 1;
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27; x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return (x >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+}
+
+static void read_vectors(const char *name) {
+	FILE *fp = fopen(name, "r");
+	char *line = NULL;
+	size_t cap = 0;
+	int max_vec = 0;
+
+	if(fp == NULL) {
+		perror(name);
+		exit(2);
+	}
+	while(getline(&line, &cap, fp) > 0) {
+		Vector *v;
+		char *p;
+		int id, len, max_e = 0;
+		double count, sum = 0;
+
+		if(line[0] != 'T') { continue; }
+		if(nr_vec == max_vec) {
+			max_vec = max_vec ? max_vec * 2 : 256;
+			vecs = realloc(vecs, max_vec * sizeof(Vector));
+		}
+		v = &vecs[nr_vec ++];
+		v->e = NULL;
+		v->n = 0;
+		for(p = line + 1; sscanf(p, ":%d:%lf %n", &id, &count, &len) == 2; p += len) {
+			if(v->n == max_e) {
+				max_e = max_e ? max_e * 2 : 64;
+				v->e = realloc(v->e, max_e * sizeof(Entry));
+			}
+			v->e[v->n].id = id;
+			v->e[v->n].count = count;
+			v->n ++;
+			sum += count;
+		}
+		for(id = 0; id < v->n && sum > 0; id ++) { v->e[id].count /= sum; }
+	}
+	free(line);
+	fclose(fp);
+}
+
+static void project() {
+	int i, j, d;
+	proj = calloc((size_t)nr_vec * dim, sizeof(double));
+	for(i = 0; i < nr_vec; i ++) {
+		for(j = 0; j < vecs[i].n; j ++) {
+			for(d = 0; d < dim; d ++) {
+				proj[(size_t)i * dim + d] += vecs[i].e[j].count * projection(vecs[i].e[j].id, d);
+			}
+		}
+	}
+}
+
+static double dist2(const double *a, const double *b) {
+	double s = 0;
+	int d;
+	for(d = 0; d < dim; d ++) { s += (a[d] - b[d]) * (a[d] - b[d]); }
+	return s;
+}
+
+/* Manhattan distance of two vectors before the projection */
+static double manhattan(const Vector *a, const Vector *b) {
+	static double *seen = NULL;
+	static int max_id = 0;
+	double s = 0;
+	int i;
+
+	for(i = 0; i < a->n; i ++) {
+		if(a->e[i].id >= max_id) {
+			int n = a->e[i].id * 2 + 1;
+			seen = realloc(seen, n * sizeof(double));
+			memset(seen + max_id, 0, (n - max_id) * sizeof(double));
+			max_id = n;
+		}
+		seen[a->e[i].id] = a->e[i].count;
+	}
+	for(i = 0; i < b->n; i ++) {
+		double x = b->e[i].id < max_id ? seen[b->e[i].id] : 0;
+		s += fabs(x - b->e[i].count);
+		if(b->e[i].id < max_id) { seen[b->e[i].id] = 0; }
+	}
+	/* the blocks of a that are not in b */
+	for(i = 0; i < a->n; i ++) {
+		s += seen[a->e[i].id];
+		seen[a->e[i].id] = 0;
+	}
+	return s;
+}
+
+static uint64_t rng_state;
+
+static double uniform() {
+	rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+	return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* k-means++ seeding, then Lloyd iterations; returns the sum of the
+ * squared distances, `assign' and `center' hold the clustering
+ */
+static double kmeans(int k, int *assign, double *center) {
+	double *d2 = malloc(nr_vec * sizeof(double));
+	int *size = malloc(k * sizeof(int));
+	double sse = 0;
+	int i, c, it;
+
+	memcpy(center, proj + (size_t)(uniform() * nr_vec) * dim, dim * sizeof(double));
+	for(i = 0; i < nr_vec; i ++) { d2[i] = dist2(proj + (size_t)i * dim, center); }
+	for(c = 1; c < k; c ++) {
+		double total = 0, r;
+		for(i = 0; i < nr_vec; i ++) { total += d2[i]; }
+		r = uniform() * total;
+		for(i = 0; i < nr_vec - 1 && r >= d2[i]; i ++) { r -= d2[i]; }
+		memcpy(center + c * dim, proj + (size_t)i * dim, dim * sizeof(double));
+		for(i = 0; i < nr_vec; i ++) {
+			double d = dist2(proj + (size_t)i * dim, center + c * dim);
+			if(d < d2[i]) { d2[i] = d; }
+		}
+	}
+
+	for(it = 0; it < NR_ITER; it ++) {
+		int changed = 0;
+		for(i = 0; i < nr_vec; i ++) {
+			int best = 0;
+			double bd = dist2(proj + (size_t)i * dim, center);
+			for(c = 1; c < k; c ++) {
+				double d = dist2(proj + (size_t)i * dim, center + c * dim);
+				if(d < bd) { bd = d; best = c; }
+			}
+			if(it == 0 || assign[i] != best) { changed = 1; }
+			assign[i] = best;
+		}
+		if(!changed) { break; }
+
+		memset(center, 0, k * dim * sizeof(double));
+		memset(size, 0, k * sizeof(int));
+		for(i = 0; i < nr_vec; i ++) {
+			int d;
+			size[assign[i]] ++;
+			for(d = 0; d < dim; d ++) { center[assign[i] * dim + d] += proj[(size_t)i * dim + d]; }
+		}
+		for(c = 0; c < k; c ++) {
+			int d;
+			for(d = 0; d < dim && size[c] > 0; d ++) { center[c * dim + d] /= size[c]; }
+		}
+		for(c = 0; c < k; c ++) {
+			/* an empty cluster takes the interval farthest from its center */
+			int far = 0;
+			if(size[c] > 0) { continue; }
+			for(i = 1; i < nr_vec; i ++) {
+				if(dist2(proj + (size_t)i * dim, center + assign[i] * dim) >
+					dist2(proj + (size_t)far * dim, center + assign[far] * dim)) { far = i; }
+			}
+			memcpy(center + c * dim, proj + (size_t)far * dim, dim * sizeof(double));
+			assign[far] = c;
+			size[c] = 1;
+		}
+	}
+
+	for(i = 0; i < nr_vec; i ++) { sse += dist2(proj + (size_t)i * dim, center + assign[i] * dim); }
+	free(d2);
+	free(size);
+	return sse;
+}
+
+/* the Bayesian information criterion of a clustering, as in X-means */
+static double bic(int k, const int *assign, double sse) {
+	int *size = calloc(k, sizeof(int));
+	double r = nr_vec, var, l = 0;
+	int i, c;
+
+	if(nr_vec <= k) {
+		free(size);
+		return -HUGE_VAL;
+	}
+	for(i = 0; i < nr_vec; i ++) { size[assign[i]] ++; }
+	var = sse / (dim * (r - k));
+	if(var <= 0) { var = 1e-300; }
+	for(c = 0; c < k; c ++) {
+		if(size[c] > 0) { l += size[c] * log(size[c] / r); }
+	}
+	l -= r * dim / 2 * log(2 * M_PI * var) + dim * (r - k) / 2;
+	free(size);
+	return l - ((k - 1) + k * dim + 1) / 2.0 * log(r);
+}
+
+static void best_kmeans(int k, int *assign, double *center, double *sse) {
+	int *a = malloc(nr_vec * sizeof(int));
+	double *cen = malloc(k * dim * sizeof(double));
+	int s;
+
+	*sse = HUGE_VAL;
+	rng_state = 0x853c49e6748fea9bull + k;
+	for(s = 0; s < NR_SEED; s ++) {
+		double e = kmeans(k, a, cen);
+		if(e < *sse) {
+			*sse = e;
+			memcpy(assign, a, nr_vec * sizeof(int));
+			memcpy(center, cen, k * dim * sizeof(double));
+		}
+	}
+	free(a);
+	free(cen);
+}
+
+int main(int argc, char *argv[]) {
+	const char *input = NULL;
+	int *assign, *best_assign, *pick, *size;
+	double *center, *best_center, *scores;
+	int i, k, c, lo, hi, best_k;
+	char name[1024];
+	FILE *sp, *wt;
+
+	for(i = 1; i < argc; i ++) {
+		if(strcmp(argv[i], "-k") == 0 && i + 1 < argc) { fixed_k = atoi(argv[++ i]); }
+		else if(strcmp(argv[i], "-maxk") == 0 && i + 1 < argc) { maxk = atoi(argv[++ i]); }
+		else if(strcmp(argv[i], "-dim") == 0 && i + 1 < argc) { dim = atoi(argv[++ i]); }
+		else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) { prefix = argv[++ i]; }
+		else if(argv[i][0] == '-' || input != NULL) { usage(argv[0]); }
+		else { input = argv[i]; }
+	}
+	if(input == NULL || dim < 1 || dim > MAX_DIM || maxk < 1 || fixed_k < 0) { usage(argv[0]); }
+
+	read_vectors(input);
+	if(nr_vec == 0) {
+		fprintf(stderr, "%s: no basic-block vector\n", input);
+		return 2;
+	}
+	project();
+
+	lo = fixed_k ? fixed_k : 1;
+	hi = fixed_k ? fixed_k : maxk;
+	if(hi > nr_vec) { hi = nr_vec; }
+	if(lo > hi) { lo = hi; }
+
+	assign = malloc(nr_vec * sizeof(int));
+	best_assign = malloc((size_t)(hi + 1) * nr_vec * sizeof(int));
+	center = malloc(hi * dim * sizeof(double));
+	best_center = malloc((size_t)(hi + 1) * hi * dim * sizeof(double));
+	scores = malloc((hi + 1) * sizeof(double));
+
+	for(k = lo; k <= hi; k ++) {
+		double sse;
+		best_kmeans(k, assign, center, &sse);
+		memcpy(best_assign + (size_t)k * nr_vec, assign, nr_vec * sizeof(int));
+		memcpy(best_center + (size_t)k * hi * dim, center, k * dim * sizeof(double));
+		scores[k] = bic(k, assign, sse);
+	}
+
+	/* the smallest k that is good enough */
+	best_k = hi;
+	if(lo < hi) {
+		double min = HUGE_VAL, max = -HUGE_VAL;
+		for(k = lo; k <= hi; k ++) {
+			if(scores[k] == -HUGE_VAL) { continue; }
+			if(scores[k] < min) { min = scores[k]; }
+			if(scores[k] > max) { max = scores[k]; }
+		}
+		for(k = lo; k <= hi; k ++) {
+			if(scores[k] != -HUGE_VAL && scores[k] >= min + bic_threshold * (max - min)) {
+				best_k = k;
+				break;
+			}
+		}
+	}
+	assign = best_assign + (size_t)best_k * nr_vec;
+	center = best_center + (size_t)best_k * hi * dim;
+
+	pick = malloc(best_k * sizeof(int));
+	size = calloc(best_k, sizeof(int));
+	for(c = 0; c < best_k; c ++) { pick[c] = -1; }
+	for(i = 0; i < nr_vec; i ++) {
+		c = assign[i];
+		size[c] ++;
+		if(pick[c] < 0 || dist2(proj + (size_t)i * dim, center + c * dim) <
+				dist2(proj + (size_t)pick[c] * dim, center + c * dim)) {
+			pick[c] = i;
+		}
+	}
+
+	snprintf(name, sizeof(name), "%s.simpoints", prefix);
+	sp = fopen(name, "w");
+	snprintf(name, sizeof(name), "%s.weights", prefix);
+	wt = fopen(name, "w");
+	if(sp == NULL || wt == NULL) {
+		perror(name);
+		return 2;
+	}
+
+	printf("%d intervals, %d clusters\n", nr_vec, best_k);
+	printf("%8s %10s %10s %10s %10s\n", "cluster", "intervals", "weight", "point", "spread");
+	double total_spread = 0;
+	for(c = 0, k = 0; c < best_k; c ++) {
+		double spread = 0;
+		if(size[c] == 0) { continue; }
+		for(i = 0; i < nr_vec; i ++) {
+			if(assign[i] == c) { spread += manhattan(&vecs[i], &vecs[pick[c]]); }
+		}
+		total_spread += spread;
+		spread /= size[c];
+		fprintf(sp, "%d %d\n", pick[c], k);
+		fprintf(wt, "%.6f %d\n", (double)size[c] / nr_vec, k);
+		printf("%8d %10d %10.4f %10d %10.4f\n", k, size[c], (double)size[c] / nr_vec, pick[c], spread);
+		k ++;
+	}
+	printf("mean spread %.4f\n", total_spread / nr_vec);
+	fclose(sp);
+	fclose(wt);
+	return 0;
+}
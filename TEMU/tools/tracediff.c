@@ -0,0 +1,371 @@
+/* tracediff: compare two golden traces, e.g. the one of TEMU with the
+ * writeback trace of the RTL, and report the first divergence with the
+ * records around it and the disassembly at its pc.
+ *
+ *   tracediff [options] <reference> <test>
+ *
+ * A trace is either in the golden_trace.txt layout (a header line, then
+ * one "%08x  %02d          %08x" line per register write) or binary
+ * (golden_trace.bin, see monitor/trace.h). Both files are mapped, and
+ * as long as they have the same layout the identical prefix is found by
+ * comparing the raw bytes 64 at a time with SSE2, without parsing a
+ * record.
+ *
+ * Writes to $0 are ignored by default, since the RTL does not report
+ * them. After a divergence the comparison can resynchronise: the next
+ * records of both traces are searched for a point where they agree
+ * again, so that known-benign differences do not hide later ones.
+ */
+
+#include "libtemu.h"
+#include "monitor/trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define TEXT_RECORD_LEN 31
+#define NR_PC_RANGE 16
+
+typedef struct {
+	const char *name;
+	const uint8_t *map;
+	size_t map_size;
+
+	bool binary;
+	const uint8_t *data;	/* the first record */
+	size_t rec_size;	/* bytes per record in the file, 0 if parsed */
+	size_t nr_rec;
+	TraceRecord *parsed;	/* text that is not fixed-width */
+} Trace;
+
+static int context = 5;
+static int max_diffs = 1;
+static int resync_window = 64;
+static int resync_match = 4;
+static uint32_t ignore_regs = 0x1;
+static struct { uint32_t lo, hi; } ignore_pc[NR_PC_RANGE];
+static int nr_ignore_pc = 0;
+
+static uint8_t *image = NULL;
+static size_t image_size = 0;
+
+static void usage(const char *prog) {
+	fprintf(stderr,
+		"Usage: %s [options] <reference> <test>\n"
+		"  -c N              records of context around a divergence (default 5)\n"
+		"  -n N              stop after N divergences, resynchronising in between (default 1)\n"
+		"  -w N              records searched ahead to resynchronise (default 64)\n"
+		"  -m N              matching records needed to resynchronise (default 4)\n"
+		"  -i FILE           instruction image for the disassembly (default inst.bin)\n"
+		"  --ignore-reg N    ignore writes to register N\n"
+		"  --keep-zero       compare writes to $0 as well\n"
+		"  --ignore-pc A[-B] ignore the records of the instructions at A (to B)\n",
+		prog);
+	exit(2);
+}
+
+static inline int hex_digit(uint8_t c) {
+	return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+static inline uint32_t parse_hex8(const uint8_t *p) {
+	uint32_t v = 0;
+	int i;
+	for(i = 0; i < 8; i ++) { v = (v << 4) | hex_digit(p[i]); }
+	return v;
+}
+
+static bool parse_line(const char *line, TraceRecord *r) {
+	return sscanf(line, "%x %u %x", &r->pc, &r->reg, &r->value) == 3;
+}
+
+static void open_trace(Trace *t, const char *name) {
+	struct stat st;
+	int fd = open(name, O_RDONLY);
+
+	memset(t, 0, sizeof(*t));
+	t->name = name;
+	if(fd < 0 || fstat(fd, &st) < 0) {
+		perror(name);
+		exit(2);
+	}
+	t->map_size = st.st_size;
+	if(t->map_size > 0) {
+		t->map = mmap(NULL, t->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(t->map == MAP_FAILED) {
+			perror(name);
+			exit(2);
+		}
+		madvise((void *)t->map, t->map_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	if(t->map_size >= TRACE_MAGIC_LEN && memcmp(t->map, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) {
+		t->binary = true;
+		t->data = t->map + TRACE_MAGIC_LEN;
+		t->rec_size = sizeof(TraceRecord);
+		t->nr_rec = (t->map_size - TRACE_MAGIC_LEN) / sizeof(TraceRecord);
+		return;
+	}
+
+	/* skip the header line unless it is a record already */
+	const uint8_t *p = t->map, *end = t->map + t->map_size;
+	const uint8_t *nl = t->map_size ? memchr(p, '\n', t->map_size) : NULL;
+	char line[128];
+	TraceRecord r;
+	if(nl != NULL) {
+		size_t len = nl - p < sizeof(line) - 1 ? nl - p : sizeof(line) - 1;
+		memcpy(line, p, len);
+		line[len] = '\0';
+		if(!parse_line(line, &r)) { p = nl + 1; }
+	}
+	t->data = p;
+
+	size_t len = end - p;
+	if(len % TEXT_RECORD_LEN == 0 && (len == 0 || (p[TEXT_RECORD_LEN - 1] == '\n' && end[-1] == '\n'))) {
+		t->rec_size = TEXT_RECORD_LEN;
+		t->nr_rec = len / TEXT_RECORD_LEN;
+		return;
+	}
+
+	/* not written by TEMU, parse it line by line */
+	size_t cap = 1 << 16;
+	t->parsed = malloc(cap * sizeof(TraceRecord));
+	while(p < end) {
+		nl = memchr(p, '\n', end - p);
+		size_t n = (nl ? nl : end) - p;
+		if(n > sizeof(line) - 1) { n = sizeof(line) - 1; }
+		memcpy(line, p, n);
+		line[n] = '\0';
+		if(parse_line(line, &r)) {
+			if(t->nr_rec == cap) {
+				cap *= 2;
+				t->parsed = realloc(t->parsed, cap * sizeof(TraceRecord));
+			}
+			t->parsed[t->nr_rec ++] = r;
+		}
+		p = nl ? nl + 1 : end;
+	}
+}
+
+static void get_record(const Trace *t, size_t i, TraceRecord *r) {
+	if(t->parsed != NULL) {
+		*r = t->parsed[i];
+	}
+	else if(t->binary) {
+		memcpy(r, t->data + i * sizeof(TraceRecord), sizeof(TraceRecord));
+	}
+	else {
+		const uint8_t *p = t->data + i * TEXT_RECORD_LEN;
+		if(p[TEXT_RECORD_LEN - 1] != '\n') {
+			fprintf(stderr, "%s: record %zu is not in the golden_trace.txt layout\n", t->name, i);
+			exit(2);
+		}
+		r->pc = parse_hex8(p);
+		r->reg = (p[10] - '0') * 10 + (p[11] - '0');
+		r->value = parse_hex8(p + 22);
+	}
+}
+
+static bool ignored(const TraceRecord *r) {
+	int i;
+	if(r->reg < 32 && (ignore_regs >> r->reg & 1)) { return true; }
+	for(i = 0; i < nr_ignore_pc; i ++) {
+		if(r->pc >= ignore_pc[i].lo && r->pc <= ignore_pc[i].hi) { return true; }
+	}
+	return false;
+}
+
+/* the first record at or after `i' that is compared */
+static size_t next_record(const Trace *t, size_t i) {
+	TraceRecord r;
+	for(; i < t->nr_rec; i ++) {
+		get_record(t, i, &r);
+		if(!ignored(&r)) { break; }
+	}
+	return i;
+}
+
+static bool same_record(const Trace *a, size_t i, const Trace *b, size_t j) {
+	TraceRecord ra, rb;
+	get_record(a, i, &ra);
+	get_record(b, j, &rb);
+	return ra.pc == rb.pc && ra.reg == rb.reg && ra.value == rb.value;
+}
+
+/* the offset of the first byte that differs, or `len' */
+static size_t first_mismatch(const uint8_t *a, const uint8_t *b, size_t len) {
+	size_t i = 0;
+#ifdef __SSE2__
+	for(; i + 64 <= len; i += 64) {
+		__m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(b + i)));
+		__m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 16)), _mm_loadu_si128((const __m128i *)(b + i + 16)));
+		__m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 32)), _mm_loadu_si128((const __m128i *)(b + i + 32)));
+		__m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 48)), _mm_loadu_si128((const __m128i *)(b + i + 48)));
+		if(_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3))) != 0xffff) { break; }
+	}
+#endif
+	for(; i < len && a[i] == b[i]; i ++);
+	return i;
+}
+
+/* number of identical records from `i' and `j' on, when the layouts are equal */
+static size_t identical_run(const Trace *a, size_t i, const Trace *b, size_t j) {
+	if(a->parsed != NULL || b->parsed != NULL || a->rec_size != b->rec_size) { return 0; }
+
+	size_t n = a->nr_rec - i < b->nr_rec - j ? a->nr_rec - i : b->nr_rec - j;
+	return first_mismatch(a->data + i * a->rec_size, b->data + j * b->rec_size, n * a->rec_size) / a->rec_size;
+}
+
+static void print_record(const Trace *t, size_t i, char mark) {
+	TraceRecord r;
+	char buf[80] = "";
+
+	if(i >= t->nr_rec) {
+		printf("%c %10zu  (end of trace)\n", mark, i);
+		return;
+	}
+	get_record(t, i, &r);
+	if(image != NULL && r.pc + 4 <= image_size) {
+		uint32_t instr;
+		memcpy(&instr, image + r.pc, 4);
+		temu_disasm(r.pc, instr, buf, sizeof(buf));
+	}
+	printf("%c %10zu  %08x  %02u  %08x%s  %s\n", mark, i, r.pc, r.reg, r.value,
+			ignored(&r) ? " (ignored)" : "", buf);
+}
+
+static void report(const Trace *a, size_t i, const Trace *b, size_t j, int nr) {
+	size_t k;
+	printf("divergence %d: %s record %zu, %s record %zu\n", nr, a->name, i, b->name, j);
+
+	printf("  %s:\n", a->name);
+	for(k = i > context ? i - context : 0; k <= i + context && k <= a->nr_rec; k ++) {
+		print_record(a, k, k == i ? '>' : ' ');
+	}
+	printf("  %s:\n", b->name);
+	for(k = j > context ? j - context : 0; k <= j + context && k <= b->nr_rec; k ++) {
+		print_record(b, k, k == j ? '>' : ' ');
+	}
+	printf("\n");
+}
+
+/* Look for the closest (i', j') after the divergence at (i, j) where
+ * `resync_match' records agree. Return false if there is none within
+ * the window.
+ */
+static bool resync(const Trace *a, size_t *i, const Trace *b, size_t *j) {
+	size_t ia[resync_window + 1], jb[resync_window + 1];
+	int na, nb, d, x, k;
+
+	for(na = 0, ia[0] = *i; na < resync_window && ia[na] < a->nr_rec; na ++) { ia[na + 1] = next_record(a, ia[na] + 1); }
+	for(nb = 0, jb[0] = *j; nb < resync_window && jb[nb] < b->nr_rec; nb ++) { jb[nb + 1] = next_record(b, jb[nb] + 1); }
+
+	for(d = 1; d <= na + nb; d ++) {
+		for(x = 0; x <= d; x ++) {
+			if(x > na || d - x > nb) { continue; }
+			size_t ii = ia[x], jj = jb[d - x];
+			for(k = 0; k < resync_match && ii < a->nr_rec && jj < b->nr_rec && same_record(a, ii, b, jj); k ++) {
+				ii = next_record(a, ii + 1);
+				jj = next_record(b, jj + 1);
+			}
+			if(k == resync_match || (k > 0 && ii >= a->nr_rec && jj >= b->nr_rec)) {
+				printf("resynchronised at %s record %zu, %s record %zu\n\n", a->name, ia[x], b->name, jb[d - x]);
+				*i = ia[x];
+				*j = jb[d - x];
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static void load_image(const char *name, bool required) {
+	FILE *fp = fopen(name, "rb");
+	if(fp == NULL) {
+		if(required) { perror(name); exit(2); }
+		return;
+	}
+	fseek(fp, 0, SEEK_END);
+	image_size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	image = malloc(image_size);
+	if(fread(image, 1, image_size, fp) != image_size) { image_size = 0; }
+	fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+	const char *files[2];
+	const char *image_file = NULL;
+	int nr_file = 0, i, nr_diff = 0;
+	Trace a, b;
+	struct timespec t0, t1;
+
+	for(i = 1; i < argc; i ++) {
+		if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) { context = atoi(argv[++ i]); }
+		else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) { max_diffs = atoi(argv[++ i]); }
+		else if(strcmp(argv[i], "-w") == 0 && i + 1 < argc) { resync_window = atoi(argv[++ i]); }
+		else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) { resync_match = atoi(argv[++ i]); }
+		else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc) { image_file = argv[++ i]; }
+		else if(strcmp(argv[i], "--ignore-reg") == 0 && i + 1 < argc) { ignore_regs |= 1u << (atoi(argv[++ i]) & 0x1f); }
+		else if(strcmp(argv[i], "--keep-zero") == 0) { ignore_regs &= ~1u; }
+		else if(strcmp(argv[i], "--ignore-pc") == 0 && i + 1 < argc && nr_ignore_pc < NR_PC_RANGE) {
+			char *end;
+			ignore_pc[nr_ignore_pc].lo = strtoul(argv[++ i], &end, 16);
+			ignore_pc[nr_ignore_pc].hi = *end == '-' ? strtoul(end + 1, NULL, 16) : ignore_pc[nr_ignore_pc].lo;
+			nr_ignore_pc ++;
+		}
+		else if(argv[i][0] == '-' || nr_file == 2) { usage(argv[0]); }
+		else { files[nr_file ++] = argv[i]; }
+	}
+	if(nr_file != 2 || context < 0 || max_diffs < 1 || resync_window < 1 || resync_match < 1) { usage(argv[0]); }
+
+	load_image(image_file ? image_file : "inst.bin", image_file != NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	open_trace(&a, files[0]);
+	open_trace(&b, files[1]);
+
+	size_t ia = 0, jb = 0, k;
+	for(;;) {
+		k = identical_run(&a, ia, &b, jb);
+		ia += k;
+		jb += k;
+
+		ia = next_record(&a, ia);
+		jb = next_record(&b, jb);
+		if(ia >= a.nr_rec || jb >= b.nr_rec) {
+			if(ia < a.nr_rec || jb < b.nr_rec) {
+				report(&a, ia, &b, jb, ++ nr_diff);
+			}
+			break;
+		}
+		if(same_record(&a, ia, &b, jb)) {
+			ia ++;
+			jb ++;
+			continue;
+		}
+
+		report(&a, ia, &b, jb, ++ nr_diff);
+		if(nr_diff >= max_diffs) { break; }
+		if(!resync(&a, &ia, &b, &jb)) {
+			printf("cannot resynchronise within %d records\n", resync_window);
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	printf("%s: %zu records, %s: %zu records, %d divergence%s, %.3f s\n",
+			a.name, a.nr_rec, b.name, b.nr_rec, nr_diff, nr_diff == 1 ? "" : "s",
+			(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	return nr_diff ? 1 : 0;
+}